@@ -22,6 +22,7 @@
 */
 
 #include <QDebug>
+#include <QTime>
 #include <unistd.h>
 #include "QMadJACK.h"
 
@@ -87,6 +88,7 @@ void QMadJACK::init()
 	lo_server_add_method( serv, "/version", "ss", QMadJACK::version_handler, this);
 	lo_server_add_method( serv, "/error", "s", QMadJACK::error_handler, this);
 	lo_server_add_method( serv, "/pong", "", QMadJACK::pong_handler, this);
+	lo_server_add_method( serv, "/ack", "is", QMadJACK::ack_handler, this);
 
 
 	// Initialse variables used in by reply handlers
@@ -97,19 +99,19 @@ void QMadJACK::init()
 	reply_duration = 0.0f;
 	reply_position = 0.0f;
 	reply_pong = 0;
+	reply_ack = 0;
+	request_id = 0;
 	
 	
 	// Triggers every 100 msec
 	first_timer = new QTimer( this );
 	first_timer->setInterval( 100 );
-	connect(first_timer, SIGNAL(timeout()), this, SLOT(update_position()));
+	connect(first_timer, SIGNAL(timeout()), this, SLOT(process_updates()));
 	
-	// Triggers every second
+	// Renew the subscription well before it runs out
 	second_timer = new QTimer( this );
-	second_timer->setInterval( 1000 );
-	connect(second_timer, SIGNAL(timeout()), this, SLOT(update_state()));
-	connect(second_timer, SIGNAL(timeout()), this, SLOT(update_duration()));
-	connect(second_timer, SIGNAL(timeout()), this, SLOT(update_filepath()));
+	second_timer->setInterval( QMADJACK_LEASE * 1000 / 3 );
+	connect(second_timer, SIGNAL(timeout()), this, SLOT(subscribe()));
 
 }
 
@@ -126,13 +128,44 @@ void QMadJACK::set_autoupdate( bool autoupdate )
 		update_duration();
 		update_filepath();
 		
+		// Then let the deck tell us when things change
+		subscribe();
+		
 	} else {
 		first_timer->stop();
 		second_timer->stop();
+		this->send_message( "/deck/unsubscribe" );
 	}
 }
 
 
+void QMadJACK::subscribe()
+{
+	lo_message mesg = lo_message_new();
+	lo_message_add_int32( mesg, QMADJACK_INTERVAL );
+	lo_message_add_int32( mesg, QMADJACK_LEASE );
+	this->send_message( "/deck/subscribe", mesg );
+	lo_message_free( mesg );
+}
+
+
+// Handle the updates the deck has sent us since last time
+void QMadJACK::process_updates()
+{
+	QString state = this->reply_state;
+	QString filepath = this->reply_filepath;
+	float duration = this->reply_duration;
+	float position = this->reply_position;
+
+	while (lo_server_recv_noblock( this->serv, 0 ) > 0) {}
+	
+	if (this->reply_state != state) emit stateChanged(this->reply_state);
+	if (this->reply_filepath != filepath) emit filepathChanged(this->reply_filepath);
+	if (this->reply_duration != duration) emit durationChanged(this->reply_duration);
+	if (this->reply_position != position) emit positionChanged(this->reply_position);
+}
+
+
 int QMadJACK::load( const QString &filepath )
 {
 	QStringList desired;
@@ -321,33 +354,61 @@ int QMadJACK::send_message( const char* path, lo_message mesg )
 }
 
 
+// Send a command, and wait for the deck to say it has been carried out
+// (mesg has the request id added to it)
 int QMadJACK::send( const QString &path,
 				    QStringList &desired,
 				    lo_message mesg )
 {
+	lo_message request = mesg ? mesg : lo_message_new();
 	
-	for(int i=0; i<QMADJACK_ATTEMPTS; i++) {
-	
-		this->send_message( path.toLatin1(), mesg );
+	if (lo_address_get_protocol( this->addr ) == LO_TCP) {
+		// Nothing gets lost over TCP, but the deck can't acknowledge over it either
+		this->send_message( path.toLatin1(), request );
+		this->get_state();
 		
-		if (desired.size()) {
-			QString state = this->get_state();
-			
-			// In error state
-			if (state == "ERROR") return 0;
+	} else {
+		// Repeats of the same request id are only carried out once
+		int id = ++this->request_id;
+		lo_message_add_int32( request, id );
+		
+		this->reply_ack = 0;
+		for(int i=0; i<QMADJACK_ATTEMPTS && this->reply_ack != id; i++) {
+			QTime timer;
+		
+			this->send_message( path.toLatin1(), request );
 			
-			for (int j=0; j < desired.size(); ++j) {
-				if (desired.at(j) == state) return 1;
+			// Wait for the acknowledgement (handling any updates that arrive first)
+			timer.start();
+			while (this->reply_ack != id && timer.elapsed() < QMADJACK_TIMEOUT) {
+				lo_server_recv_noblock( this->serv, QMADJACK_TIMEOUT - timer.elapsed() );
 			}
-
-		} else {
-			// Success
-			return 1;
+		}
+		
+		if (this->reply_ack != id) {
+			qWarning( "No acknowledgement from MadJACK server after %d attempts.", QMADJACK_ATTEMPTS );
 		}
 	}
-
-	// Failure
-	return 0;
+	
+	if (!mesg) lo_message_free( request );
+	
+	// The acknowledgement has the state the command left the deck in,
+	// which may still be changing (e.g. LOADING), so ask until it settles
+	QTime timer;
+	timer.start();
+	while (desired.size() && !desired.contains( this->reply_state ) &&
+	       this->reply_state != "ERROR" && timer.elapsed() < QMADJACK_TIMEOUT)
+	{
+		usleep( QMADJACK_SETTLE * 1000 );
+		this->get_state();
+	}
+	
+	// In error state
+	if (this->reply_state == "ERROR") return 0;
+	
+	// Did it end up in the right state ?
+	if (desired.size()==0) return 1;
+	return desired.contains( this->reply_state ) ? 1 : 0;
 }
 
 
@@ -453,3 +514,16 @@ int QMadJACK::pong_handler(const char *, const char *,
 	obj->reply_pong++;
     return 0;
 }
+
+int QMadJACK::ack_handler(const char *, const char *, 
+		lo_arg **argv, int, lo_message, void *user_data)
+{
+	QMadJACK *obj = (QMadJACK*)user_data;
+	
+	// Ignore late acknowledgements of earlier commands
+	if (argv[0]->i == obj->request_id) {
+		obj->reply_ack = argv[0]->i;
+		obj->reply_state = &argv[1]->s;
+	}
+    return 0;
+}
@@ -32,6 +32,10 @@
 
 
 #define QMADJACK_ATTEMPTS	(5)
+#define QMADJACK_TIMEOUT	(1000)		// Milliseconds to wait for each acknowledgement
+#define QMADJACK_INTERVAL	(100)		// Milliseconds between position updates
+#define QMADJACK_SETTLE		(10)		// Milliseconds between checks that the state has settled
+#define QMADJACK_LEASE		(30)		// Seconds each subscription lasts
 
 
 class QMadJACK : public QObject
@@ -112,17 +116,22 @@ class QMadJACK : public QObject
 		static int pong_handler(const char *path, const char *types, 
 			lo_arg **argv, int argc, lo_message msg, void *user_data);
 
+		static int ack_handler(const char *path, const char *types, 
+			lo_arg **argv, int argc, lo_message msg, void *user_data);
+
 	private slots:
-		void update_state();	// called by timer
-		void update_position();	// called by timer
-		void update_duration();	// called by timer
-		void update_filepath();	// called by timer
+		void update_state();	// called by set_autoupdate()
+		void update_position();	// called by set_autoupdate() and get_position()
+		void update_duration();	// called by set_autoupdate() and get_duration()
+		void update_filepath();	// called by set_autoupdate() and get_filepath()
+		void process_updates();	// called by first_timer
+		void subscribe();		// called by second_timer and set_autoupdate()
 		
 		
 	// Private variables
 	private:
 		QTimer		*first_timer;		// Triggers every 100 msec
-		QTimer		*second_timer;		// Triggers every second
+		QTimer		*second_timer;		// Renews the subscription
 	
 		lo_address	addr;
 		lo_server	serv;
@@ -134,6 +143,9 @@ class QMadJACK : public QObject
 		float		reply_duration;
 		float		reply_position;
 		int			reply_pong;
+		int			reply_ack;
+		
+		int			request_id;			// Id of the last command sent
 		
 };
 
@@ -14,7 +14,7 @@ use strict;
 
 use vars qw/$VERSION $ATTEMPTS/;
 
-$VERSION="0.04";
+$VERSION="0.05";
 $ATTEMPTS=5;
 
 
@@ -26,6 +26,8 @@ sub new {
     # Bless the hash into an object
     my $self = { 
     	pong => 0,
+    	ack => undef,
+    	request_id => 0,
     	state => undef,
     	version => undef,
     	error => undef,
@@ -57,6 +59,7 @@ sub new {
     $self->{lo}->add_method( '/version', 'ss', \&_version_handler, $self );
     $self->{lo}->add_method( '/error', 's', \&_error_handler, $self );
     $self->{lo}->add_method( '/pong', '', \&_pong_handler, $self );
+    $self->{lo}->add_method( '/ack', 'is', \&_ack_handler, $self );
     
     # Check MadJACK server is there
     if (!$self->ping()) {
@@ -95,7 +98,8 @@ sub cue {
 	if (defined $cuepoint) {
 		return $self->_send( '/deck/cue', 'LOADING|READY', 'd', $cuepoint);
 	} else {
-		return $self->_send( '/deck/cue', 'LOADING|READY');
+		# A lone request id would be taken as the cue point
+		return $self->_send( '/deck/cue', 'LOADING|READY', 'd', 0);
 	}
 }
 
@@ -197,6 +201,16 @@ sub _pong_handler {
 	return 0; # Success
 }
 
+sub _ack_handler {
+	my ($serv, $mesg, $path, $typespec, $userdata, @params) = @_;
+	# Ignore late acknowledgements of earlier commands
+	if ($params[0] == $userdata->{request_id}) {
+		$userdata->{ack}=$params[0];
+		$userdata->{state}=$params[1];
+	}
+	return 0; # Success
+}
+
 sub get_url {
 	my $self=shift;
 	return $self->{addr}->get_url();
@@ -206,27 +220,48 @@ sub get_url {
 sub _send {
 	my $self=shift;
 	my ($path, $desired, $typespec, @params) = @_;
-	my $state = undef;
 	
 	# Empty typespec if non specified
 	$typespec = '' unless (defined $typespec);
 	
+	# Number the request, so that the deck only carries it out once
+	my $id = ++$self->{request_id};
+	$self->{ack} = undef;
+	$self->{state} = undef;
+	
 	# Try a few times
 	for(1..$ATTEMPTS) {
-		my $result = $self->{lo}->send( $self->{addr}, $path, $typespec, @params );
+		my $result = $self->{lo}->send( $self->{addr}, $path, $typespec.'i', @params, $id );
 		warn "Warning: failed to send '$path' OSC message.\n" if ($result<1);
 
-		# Check what state the player is in now
-		if (defined $desired) {
-			$state = $self->get_state();
-			last if ($state =~ /^$desired$/i);
-		} else {
-			return 0;
+		# Wait up to a second for the acknowledgement
+		my $deadline = time() + 1;
+		while (!defined $self->{ack} && time() <= $deadline) {
+			last if ($self->{lo}->recv_noblock( 1000 ) < 1);
 		}
+		last if (defined $self->{ack});
+	}
+	
+	if (!defined $self->{ack}) {
+		warn "Failed to get acknowledgement from MadJACK server after $ATTEMPTS attempts.\n";
+		return 0;
+	}
+	
+	# Nothing to check (returns 0, as it always has)
+	return 0 unless (defined $desired);
+	
+	# The acknowledgement has the state the command left the deck in,
+	# which may still be changing (e.g. LOADING), so ask until it settles
+	my $deadline = time() + 1;
+	while ((!defined $self->{state} || $self->{state} !~ /^($desired|ERROR)$/i) &&
+	       time() <= $deadline)
+	{
+		select( undef, undef, undef, 0.01 );
+		$self->get_state();
 	}
 	
 	# Finally return true if we are in desired state
-	if ($state =~ /^$desired$/i) { return 1 }
+	if (defined $self->{state} && $self->{state} =~ /^$desired$/i) { return 1 }
 	else { return 0 }
 }
 
@@ -291,6 +326,11 @@ The Audio::MadJACK module uses Net::LibLO to talk to a
 MadJACK (MPEG Audio Deck) server. It has an Object Oriented style 
 API making it simple to control multiple decks from a single script.
 
+Commands are sent with a request id, and are sent again (with the same
+id) if the deck doesn't acknowledge them within a second. The deck only
+carries out each request once. This needs a version of MadJACK that
+sends /ack.
+
 
 =over 4
 
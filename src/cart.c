@@ -0,0 +1,209 @@
+/*
+
+	cart.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <jack/jack.h>
+
+#include "madjack.h"
+#include "maddecode.h"
+#include "pcmbuffer.h"
+#include "pcmcache.h"
+#include "cart.h"
+#include "status.h"
+#include "config.h"
+
+
+// ------- Globals -------
+float cart_duration = 0.0f;				// Longest track to play as a cart (in seconds)
+
+static pcm_buffer_t *cart_arena = NULL;		// Memory that carts are decoded into
+static pcm_buffer_t cart_shared;				// Cart mapped from the shared cache
+static pcm_buffer_t *cart_pcm = NULL;			// Audio of the cart that is loaded
+static int cart_loaded = 0;					// Set when the loaded track is a cart
+static unsigned int cart_position = 0;		// Playback position in the cart (in frames)
+
+
+
+/*
+ * Decode the whole of a short track into memory, so that it can be
+ * played by the JACK callback without using the ringbuffer or
+ * the decoder thread.
+ *
+ * Returns 1 if the track was loaded as a cart, or 0 if it is too long
+ * to be a cart (and should be played normally).
+ */
+
+int load_cart( input_file_t *input )
+{
+	unsigned long bytes;
+	int at_eof = 0;
+	long frames;
+	
+	// Cart mode disabled ?
+	if (cart_arena == NULL) return 0;
+
+	eject_cart();
+
+	// Quick check that the file isn't too big
+	mpeg_audio_length( input );
+	bytes = input->end_pos - input->start_pos;
+	if (bytes > cart_duration * CART_BYTES_PER_SEC) {
+		if (verbose) printf("File is too big to load as a cart (%lu bytes).\n", bytes);
+		return 0;
+	}
+	
+	if (pcmcache_lookup( &input->file_stat, &cart_shared )) {
+		// Another process has already decoded it
+		cart_pcm = &cart_shared;
+		frames = cart_shared.length;
+		input->samplerate = jack_get_sample_rate( client );
+	} else {
+		// Decode the whole file
+		frames = decode_to_buffer( input, input->file, 0, cart_arena, &at_eof );
+		if (frames <= 0 || !at_eof) {
+			if (verbose) printf("Track is too long to load as a cart.\n");
+			return 0;
+		}
+		cart_pcm = cart_arena;
+		
+		// Let other processes use it
+		pcmcache_store( &input->file_stat, cart_arena );
+	}
+	
+	// Work out the exact duration
+	input->duration = (float)frames / jack_get_sample_rate( client );
+	input->position = 0.0f;
+	cart_position = 0;
+	cart_loaded = 1;
+	status_update( 1 );
+	
+	if (verbose) printf("Loaded cart: %ld frames (%2.2f seconds).\n", frames, input->duration);
+
+	return 1;
+}
+
+
+// Move the playback position of the cart
+void cue_cart( float cuepoint )
+{
+	jack_nframes_t rate = jack_get_sample_rate( client );
+	unsigned int frame;
+	
+	// Clamp before converting, so that the conversion is defined
+	if (!(cuepoint > 0.0f)) cuepoint = 0.0f;
+	if (cuepoint > (float)cart_pcm->length / rate) cuepoint = (float)cart_pcm->length / rate;
+	
+	frame = cuepoint * rate;
+	if (frame > cart_pcm->length) frame = cart_pcm->length;
+	
+	cart_position = frame;
+	input_file->position = (float)frame / jack_get_sample_rate( client );
+}
+
+
+void eject_cart()
+{
+	int was_loaded = cart_loaded;
+	
+	cart_loaded = 0;
+	__sync_synchronize();
+	
+	// Let the callback finish any period it was reading the cart in,
+	// before the audio is unmapped
+	if (was_loaded) {
+		jack_nframes_t rate = jack_get_sample_rate( client );
+		usleep( 1000 + (1000000ULL * jack_get_buffer_size( client )) / rate );
+	}
+	
+	cart_position = 0;
+	cart_pcm = NULL;
+	if (cart_arena) cart_arena->length = 0;
+	if (cart_shared.samples[0]) pcmcache_release( &cart_shared );
+}
+
+
+int cart_is_loaded()
+{
+	return cart_loaded;
+}
+
+
+pcm_buffer_t* get_cart_pcm()
+{
+	return cart_pcm;
+}
+
+
+// Copy audio for one channel from the cart into a JACK buffer
+// Returns the number of frames copied
+unsigned int read_cart( unsigned int channel, float* buffer, unsigned int nframes )
+{
+	unsigned int avail = cart_pcm->length - cart_position;
+
+	if (nframes > avail) nframes = avail;
+	memcpy( buffer, cart_pcm->samples[channel] + cart_position, nframes * sizeof(float) );
+	
+	return nframes;
+}
+
+
+// Move playback position on, once all channels have been read
+void advance_cart( unsigned int nframes )
+{
+	cart_position += nframes;
+	if (cart_position > cart_pcm->length)
+		cart_position = cart_pcm->length;
+}
+
+
+unsigned long cart_memory_usage()
+{
+	return pcm_buffer_bytes( cart_arena ) + pcm_buffer_bytes( &cart_shared );
+}
+
+
+void init_cart()
+{
+	unsigned int frames = cart_duration * jack_get_sample_rate( client );
+	
+	// Cart mode disabled ?
+	if (frames == 0) return;
+	
+	cart_arena = init_pcm_buffer( frames );
+	if (verbose) printf("Size of the cart arena is %2.2f seconds (%lu bytes).\n",
+	                    cart_duration, pcm_buffer_bytes( cart_arena ) );
+}
+
+
+void finish_cart()
+{
+	// (JACK has already been shut down, so there's nothing to wait for)
+	cart_loaded = 0;
+	eject_cart();
+	finish_pcm_buffer( cart_arena );
+	cart_arena = NULL;
+}
+
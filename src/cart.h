@@ -0,0 +1,50 @@
+/*
+
+	cart.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "madjack.h"
+
+#ifndef _CART_H_
+#define _CART_H_
+
+
+// Constants
+#define CART_BYTES_PER_SEC		(40000)		// Largest file allowed per second (320kbps)
+
+
+// Globals
+extern float cart_duration;
+
+
+// Prototypes
+void init_cart();
+void finish_cart();
+int load_cart( input_file_t *input );
+void cue_cart( float cuepoint );
+void eject_cart();
+int cart_is_loaded();
+pcm_buffer_t* get_cart_pcm();
+unsigned int read_cart( unsigned int channel, float* buffer, unsigned int nframes );
+void advance_cart( unsigned int nframes );
+unsigned long cart_memory_usage();
+
+#endif
@@ -0,0 +1,350 @@
+/*
+
+	command.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <lo/lo.h>
+
+#include "madjack.h"
+#include "control.h"
+#include "command.h"
+#include "schedule.h"
+#include "transport.h"
+#include "group.h"
+#include "playlist.h"
+#include "oscreply.h"
+#include "config.h"
+
+
+/*
+ * Commands that change the deck are put on a queue and carried out,
+ * in the order they arrived, by the control worker thread. Loading a
+ * track can block for a long time (opening a file on a slow network
+ * filesystem, or waiting for the old decoder thread to finish), so this
+ * keeps the OSC server threads free to answer queries and pings, which
+ * are read from the status snapshot rather than waiting.
+ *
+ * A command sent with a request id is acknowledged once it has been
+ * carried out, with /ack and the state the deck is then in.
+ *
+ * The last few request ids are remembered along with who sent them, so
+ * that a client can safely send a command again if it didn't hear the
+ * acknowledgement. A repeat of a command that has already been carried
+ * out is acknowledged again instead; a repeat of one that is still
+ * waiting is ignored, as it will be acknowledged soon anyway.
+ */
+
+
+typedef struct request_struct {
+	int id;								// Request id (0 if unused)
+	int proto;							// Address it came from
+	char host[COMMAND_MAX_HOST];
+	char port[COMMAND_MAX_PORT];
+	int state;							// State acknowledged with (STARTING-1 until done)
+} request_t;
+
+
+// ------- Globals -------
+static command_t queue[COMMAND_QUEUE_SIZE];		// Commands waiting to be carried out
+static unsigned int queue_head = 0;				// Next command to carry out
+static unsigned int queue_count = 0;			// Number of commands waiting
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_ready = PTHREAD_COND_INITIALIZER;
+
+static request_t requests[COMMAND_RECENT];		// Recent request ids (also locked by queue_lock)
+static unsigned int next_request = 0;			// Oldest entry, to be replaced next
+
+static pthread_t worker_thread;					// Thread that carries out the commands
+static int worker_running = 0;					// Cleared to stop the thread
+
+static osc_reply_t ack_reply;					// Acknowledgement, built once
+
+
+
+// Set up a command with no arguments, and no one to acknowledge to
+void command_init( command_t *cmd, command_type_t type )
+{
+	cmd->type = type;
+	cmd->value[0] = cmd->value[1] = cmd->value[2] = 0.0f;
+	cmd->index = 0;
+	cmd->frame = 0;
+	cmd->time = 0;
+	cmd->name[0] = '\0';
+	cmd->id = 0;
+	cmd->serv = NULL;
+}
+
+
+// Returns 0 on success, or -1 if the name is too long
+int command_set_name( command_t *cmd, const char* name )
+{
+	if (strlen( name ) >= COMMAND_MAX_NAME) {
+		fprintf(stderr, "Warning: name is too long for a command: %s\n", name);
+		return -1;
+	}
+	
+	strcpy( cmd->name, name );
+	return 0;
+}
+
+
+// Acknowledge the command with a request id, once it has been carried out
+// Returns 0 on success
+int command_reply_to( command_t *cmd, int id, lo_address addr, lo_server serv )
+{
+	const char *host = lo_address_get_hostname( addr );
+	const char *port = lo_address_get_port( addr );
+	
+	if (id == 0) return 0;
+	
+	// Replies can't be sent back down a TCP connection from another thread
+	if (lo_address_get_protocol( addr ) == LO_TCP) {
+		if (verbose) printf("Not acknowledging request %d made over TCP.\n", id);
+		return -1;
+	}
+	
+	if (strlen( host ? host : "" ) >= COMMAND_MAX_HOST ||
+	    strlen( port ? port : "" ) >= COMMAND_MAX_PORT) return -1;
+	
+	strcpy( cmd->host, host ? host : "" );
+	strcpy( cmd->port, port ? port : "" );
+	cmd->proto = lo_address_get_protocol( addr );
+	cmd->serv = serv;
+	cmd->id = id;
+	
+	return 0;
+}
+
+
+// Find a request sent by the same client as a command (must hold lock)
+static
+request_t* find_request( const command_t *cmd )
+{
+	unsigned int i;
+	
+	for (i=0; i<COMMAND_RECENT; i++) {
+		request_t *req = &requests[i];
+		if (req->id == cmd->id && req->proto == cmd->proto &&
+		    strcmp( req->host, cmd->host ) == 0 &&
+		    strcmp( req->port, cmd->port ) == 0) return req;
+	}
+	
+	return NULL;
+}
+
+
+// Remember a request, forgetting the oldest one (must hold lock)
+static
+void add_request( const command_t *cmd )
+{
+	request_t *req = &requests[next_request];
+	
+	req->id = cmd->id;
+	req->proto = cmd->proto;
+	strcpy( req->host, cmd->host );
+	strcpy( req->port, cmd->port );
+	req->state = MADJACK_STATE_STARTING - 1;
+	next_request = (next_request + 1) % COMMAND_RECENT;
+}
+
+
+static
+void send_ack( const command_t *cmd, int state )
+{
+	lo_address addr = lo_address_new_with_proto( cmd->proto,
+	                                             cmd->host[0] ? cmd->host : NULL,
+	                                             cmd->port );
+	
+	if (!addr) return;
+	command_acknowledge( addr, cmd->serv, cmd->id, state );
+	lo_address_free( addr );
+}
+
+
+// Add a command to the end of the queue
+// Returns 0 on success, or -1 if the queue is full
+int command_submit( const command_t *cmd )
+{
+	request_t *req = NULL;
+	int result = 0;
+	int done = 0;
+	
+	pthread_mutex_lock( &queue_lock );
+	if (cmd->id) req = find_request( cmd );
+	if (req) {
+		// Seen it before
+		done = req->state;
+	} else if (queue_count < COMMAND_QUEUE_SIZE) {
+		queue[(queue_head + queue_count) % COMMAND_QUEUE_SIZE] = *cmd;
+		queue_count++;
+		if (cmd->id) add_request( cmd );
+		pthread_cond_signal( &queue_ready );
+	} else {
+		result = -1;
+	}
+	pthread_mutex_unlock( &queue_lock );
+	
+	if (result) fprintf(stderr, "Warning: command queue is full, dropping command.\n");
+	
+	if (req) {
+		if (verbose) printf("Duplicate of request %d, not carrying it out again.\n", cmd->id);
+		if (done >= MADJACK_STATE_STARTING) send_ack( cmd, done );
+	}
+	
+	return result;
+}
+
+
+static
+void run_command( const command_t *cmd )
+{
+	const char *group = cmd->name;
+	
+	switch (cmd->type) {
+		case COMMAND_PLAY: do_play(); break;
+		case COMMAND_PLAY_AT: schedule_play( cmd->frame, cmd->time, cmd->value[0] ); break;
+		case COMMAND_PAUSE: do_pause(); break;
+		case COMMAND_STOP: do_stop(); break;
+		case COMMAND_STOP_AT: schedule_stop( cmd->frame ); break;
+		case COMMAND_FINISH_STOP: schedule_finish_stop(); break;
+		case COMMAND_LOCATE: transport_locate( cmd->frame, (int)cmd->value[0], cmd->index ); break;
+		case COMMAND_CUE: do_cue( cmd->value[0] ); break;
+		case COMMAND_SEEK: do_seek( cmd->value[0] ); break;
+		case COMMAND_LOOP: do_loop( cmd->value[0], cmd->value[1], cmd->value[2] ); break;
+		case COMMAND_UNLOOP: do_unloop(); break;
+		case COMMAND_SET_HOTCUE: do_set_hotcue( cmd->index, cmd->value[0] ); break;
+		case COMMAND_FIRE_HOTCUE: do_fire_hotcue( cmd->index ); break;
+		case COMMAND_EJECT: do_eject(); break;
+		case COMMAND_LOAD: do_load( cmd->name, preload ); break;
+		case COMMAND_PRELOAD: do_load( cmd->name, 1 ); break;
+		case COMMAND_GROUP_ARM: group_arm( cmd->name ); break;
+		case COMMAND_GROUP_DISARM: group_disarm(); break;
+		case COMMAND_PLAYLIST_CROSSFADE: playlist_crossfade(); break;
+		case COMMAND_PLAYLIST_ADVANCE: playlist_advance(); break;
+		
+		case COMMAND_GROUP_PLAY:
+			// Default to the group this deck is armed in
+			if (group[0] == '\0') group = group_get_armed();
+			if (group) {
+				group_play( group, cmd->frame );
+			} else {
+				fprintf(stderr, "Warning: deck isn't armed in a group.\n");
+			}
+		break;
+	}
+}
+
+
+// Send /ack with a request id and a deck state
+// Returns the result of sending it
+int command_acknowledge( lo_address addr, lo_server serv, int id, int state )
+{
+	osc_reply_t reply;
+	int result;
+	
+	osc_reply_begin( &reply, &ack_reply );
+	osc_reply_add_int32( &reply, id );
+	osc_reply_add_string( &reply, get_state_name( state ) );
+	result = osc_reply_send( &reply, addr, serv );
+	if (result < 1) {
+		fprintf(stderr, "Error: sending acknowledgement failed: %s\n", lo_address_errstr(addr));
+	}
+	
+	return result;
+}
+
+
+// Remember the state a request finished in, and acknowledge it
+static
+void finish_request( const command_t *cmd )
+{
+	int state = get_state();
+	request_t *req;
+	
+	pthread_mutex_lock( &queue_lock );
+	if ((req = find_request( cmd ))) req->state = state;
+	pthread_mutex_unlock( &queue_lock );
+	
+	send_ack( cmd, state );
+}
+
+
+static
+void* thread_worker( void* arg )
+{
+	command_t cmd;
+	
+	pthread_mutex_lock( &queue_lock );
+	while (worker_running) {
+		if (queue_count == 0) {
+			pthread_cond_wait( &queue_ready, &queue_lock );
+			continue;
+		}
+		
+		cmd = queue[queue_head];
+		queue_head = (queue_head + 1) % COMMAND_QUEUE_SIZE;
+		queue_count--;
+		
+		// Let more commands arrive while this one is carried out
+		pthread_mutex_unlock( &queue_lock );
+		run_command( &cmd );
+		if (cmd.id) finish_request( &cmd );
+		pthread_mutex_lock( &queue_lock );
+	}
+	pthread_mutex_unlock( &queue_lock );
+	
+	return NULL;
+}
+
+
+void init_command()
+{
+	int result;
+	
+	osc_reply_template( &ack_reply, "/ack", "is" );
+
+	worker_running = 1;
+	result = pthread_create( &worker_thread, NULL, thread_worker, NULL );
+	if (result) {
+		fprintf(stderr, "Error: return code from pthread_create() is %d\n", result);
+		exit(-1);
+	}
+}
+
+
+// Stop the worker, once it has finished the command it is carrying out
+// (anything still waiting is dropped)
+void finish_command()
+{
+	if (!worker_running) return;
+	
+	pthread_mutex_lock( &queue_lock );
+	worker_running = 0;
+	queue_count = 0;
+	pthread_cond_signal( &queue_ready );
+	pthread_mutex_unlock( &queue_lock );
+	
+	pthread_join( worker_thread, NULL );
+}
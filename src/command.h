@@ -0,0 +1,90 @@
+/*
+
+	command.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "madjack.h"
+#include <lo/lo.h>
+
+#ifndef _COMMAND_H_
+#define _COMMAND_H_
+
+
+// Constants
+#define COMMAND_QUEUE_SIZE		(64)		// Most commands that can be waiting at once
+#define COMMAND_MAX_NAME		(1024)		// Longest file path or group name
+#define COMMAND_MAX_HOST		(256)		// Longest hostname to acknowledge to
+#define COMMAND_MAX_PORT		(128)		// Longest port (or Unix socket path) to acknowledge to
+#define COMMAND_RECENT			(64)		// Number of request ids remembered, to spot duplicates
+
+
+// Commands that change the deck
+typedef enum {
+	COMMAND_PLAY,
+	COMMAND_PLAY_AT,
+	COMMAND_PAUSE,
+	COMMAND_STOP,
+	COMMAND_STOP_AT,
+	COMMAND_CUE,
+	COMMAND_SEEK,
+	COMMAND_LOOP,
+	COMMAND_UNLOOP,
+	COMMAND_SET_HOTCUE,
+	COMMAND_FIRE_HOTCUE,
+	COMMAND_EJECT,
+	COMMAND_LOAD,
+	COMMAND_PRELOAD,
+	COMMAND_GROUP_ARM,
+	COMMAND_GROUP_DISARM,
+	COMMAND_GROUP_PLAY,
+	COMMAND_FINISH_STOP,
+	COMMAND_LOCATE,
+	COMMAND_PLAYLIST_CROSSFADE,
+	COMMAND_PLAYLIST_ADVANCE
+} command_type_t;
+
+
+typedef struct command_struct {
+	command_type_t type;
+	float value[3];						// Times (in seconds)
+	int index;							// Hot cue number (or set to catch up with the transport)
+	jack_nframes_t frame;				// JACK frame time (for timetagged commands)
+	jack_time_t time;					// JACK time that the timetag refers to (in usecs)
+	char name[COMMAND_MAX_NAME];		// File path or group name
+	
+	int id;								// Request id to acknowledge (0 for none)
+	lo_server serv;						// Server to acknowledge from
+	int proto;							// Address to acknowledge to
+	char host[COMMAND_MAX_HOST];
+	char port[COMMAND_MAX_PORT];
+} command_t;
+
+
+// Prototypes
+void init_command();
+void finish_command();
+void command_init( command_t *cmd, command_type_t type );
+int command_set_name( command_t *cmd, const char* name );
+int command_reply_to( command_t *cmd, int id, lo_address addr, lo_server serv );
+int command_submit( const command_t *cmd );
+int command_acknowledge( lo_address addr, lo_server serv, int id, int state );
+
+#endif
@@ -29,10 +29,20 @@
 #include <termios.h>
 #include <ctype.h>
 #include <errno.h>
+#include <jack/transport.h>
 
 #include "control.h"
+#include "command.h"
+#include "playlist.h"
 #include "madjack.h"
 #include "maddecode.h"
+#include "preload.h"
+#include "cart.h"
+#include "overlay.h"
+#include "hotcue.h"
+#include "seek.h"
+#include "loop.h"
+#include "status.h"
 #include "config.h"
 
 
@@ -40,6 +50,10 @@
 // ------- Globals -------
 struct termios saved_attributes;
 
+static pcm_buffer_t *located_pcm = NULL;		// Audio decoded where the transport stopped
+static unsigned long located_frame = 0;			// MPEG Audio frame that it starts at
+static jack_nframes_t located_sample = 0;		// Transport frame it was decoded for
+
 
 
 static void
@@ -116,7 +130,6 @@ float read_cuepoint()
 
 
 // Concatinate a filename on the end of the root path
-static
 char* build_fullpath( const char* root, const char* name )
 {
 	int len = 0;
@@ -154,6 +167,18 @@ char* build_fullpath( const char* root, const char* name )
 }
 
 
+// Stop playing from memory and stop the decoder thread
+// (throwing away any audio that has been decoded)
+static
+void discard_decoded()
+{
+	stop_loop();
+	stop_overlay();
+	finish_decoder_thread();
+	warm_stopped = 0;
+}
+
+
 // Start playing
 void do_play()
 {
@@ -168,6 +193,11 @@ void do_play()
 	{
 		play_when_ready = 1;
 	}
+	else if (get_state() == MADJACK_STATE_STOPPED && warm_stopped)
+	{
+		// Carry on from where we stopped
+		set_state( MADJACK_STATE_PLAYING );
+	}
 	else if (get_state() != MADJACK_STATE_PLAYING)
 	{
 		fprintf(stderr, "Warning: Can't change from %s to state PLAYING.\n", get_state_name(get_state()) );
@@ -179,6 +209,7 @@ void do_play()
 void do_cue(float cuepoint)
 {
 	if (verbose) printf("-> do_cue(%f)\n", cuepoint);
+	playlist_cancel();
 
 	// Stop first
 	if (get_state() == MADJACK_STATE_PLAYING ||
@@ -187,6 +218,31 @@ void do_cue(float cuepoint)
 		do_stop();
 	}
 	
+	// Parked by a warm stop ?
+	if (get_state() == MADJACK_STATE_STOPPED && warm_stopped) {
+		if (input_file->position == cuepoint) {
+			// Already in the right place
+			set_state( MADJACK_STATE_READY );
+			return;
+		}
+		discard_decoded();
+	}
+	
+	// Carts are already in memory, so just move the position
+	if (cart_is_loaded()) {
+		if (get_state() == MADJACK_STATE_READY ||
+		    get_state() == MADJACK_STATE_STOPPED)
+		{
+			cue_cart( cuepoint );
+			set_state( MADJACK_STATE_READY );
+		}
+		else
+		{
+			fprintf(stderr, "Warning: Can't change from %s to state READY.\n", get_state_name(get_state()) );
+		}
+		return;
+	}
+	
 	// Had cue-point changed?
 	if (get_state() == MADJACK_STATE_READY &&
 	    input_file->position != cuepoint)
@@ -240,11 +296,18 @@ void do_stop()
 	    get_state() == MADJACK_STATE_READY || 
 	    get_state() == MADJACK_STATE_LOADING )
 	{
+		int park = (warm_stop && get_state() != MADJACK_STATE_LOADING);
+	
 		// Store our new state
 		set_state( MADJACK_STATE_STOPPED );
 		
-		// Stop decoder thread
-		finish_decoder_thread();
+		if (park) {
+			// Leave the decoder blocked on a full ringbuffer,
+			// so that playing again can start straight away
+			warm_stopped = 1;
+		} else {
+			discard_decoded();
+		}
 	}
 	else if (get_state() != MADJACK_STATE_STOPPED)
 	{
@@ -258,6 +321,7 @@ void do_stop()
 void do_eject()
 {
 	if (verbose) printf("-> do_eject()\n");
+	playlist_cancel();
 
 	// Stop first
 	if (get_state() == MADJACK_STATE_PLAYING ||
@@ -272,7 +336,7 @@ void do_eject()
 	{
 
 		// Ensure decoder thread is terminated
-		finish_decoder_thread();
+		discard_decoded();
 
 		// Close the input file
 		if (input_file->file) {
@@ -280,8 +344,17 @@ void do_eject()
 			input_file->file = NULL;
 			free(input_file->filepath);
 			input_file->filepath = NULL;
+			free(input_file->fullpath);
+			input_file->fullpath = NULL;
 		}
 		
+		// Free the preloaded file
+		free_preload( input_file );
+		
+		// Forget the cart and hot cues
+		eject_cart();
+		clear_hotcues();
+		
 		// Reset positions
 		input_file->position = 0.0;
 		input_file->duration = 0.0;
@@ -291,6 +364,7 @@ void do_eject()
 
 		// Deck is now empty
 		set_state( MADJACK_STATE_EMPTY );
+		status_update( 1 );
 	}
 	else if (get_state() != MADJACK_STATE_EMPTY)
 	{
@@ -302,9 +376,10 @@ void do_eject()
 
 
 // Load Track into Deck
-void do_load( const char* filepath )
+// (optionally reading the whole file into memory first)
+void do_load( const char* filepath, int preload )
 {
-	if (verbose) printf("-> do_load(%s)\n", filepath);
+	if (verbose) printf("-> do_load(%s, %d)\n", filepath, preload);
 	
 	// Can only load if Deck is empty
 	if (get_state() != MADJACK_STATE_EMPTY )
@@ -331,10 +406,33 @@ void do_load( const char* filepath )
 			free( fullpath );
 			return;
 		}
+		fstat( fileno( input_file->file ), &input_file->file_stat );
+		
+		// Read the whole file into memory ?
+		if (preload) {
+			int err = preload_input_file( input_file );
+			if (err) {
+				error_handler( "Failed to preload file: %s: %s", strerror( err ), fullpath);
+				fclose( input_file->file );
+				input_file->file = NULL;
+				free( fullpath );
+				return;
+			}
+		}
 		
 		// Copy string
 		input_file->filepath = strdup( filepath );
-		free( fullpath );
+		input_file->fullpath = fullpath;
+		status_update( 1 );
+
+		// Short enough to decode into memory?
+		if (cart_duration > 0.0f && load_cart( input_file )) {
+			set_state( MADJACK_STATE_READY );
+			return;
+		}
+		
+		// Failed to decode cart ?
+		if (get_state() == MADJACK_STATE_ERROR) return;
 
 		// Cue up the new file	
 		do_cue(0.0f);
@@ -347,6 +445,306 @@ void do_load( const char* filepath )
 }
 
 
+// Start playing from audio already decoded into memory, which starts
+// at MPEG audio frame 'frame', while decoding carries on behind it
+static
+void play_from_buffer( pcm_buffer_t *pcm, unsigned long frame )
+{
+	unsigned int fade = 0;
+	
+	play_when_ready = 0;
+	
+	// Crossfade if we are already playing
+	if (get_state() == MADJACK_STATE_PLAYING)
+		fade = OVERLAY_CROSSFADE_LEN * jack_get_sample_rate( client );
+	
+	// Play the buffer in the next period
+	start_overlay( pcm, 0, fade );
+	input_file->position = frame_to_seconds( input_file, frame );
+	set_state( MADJACK_STATE_PLAYING );
+	
+	// Once the callback has stopped reading the ringbuffer,
+	// restart the decoder from the end of the buffer
+	wait_for_overlay_start();
+	restart_decoder_thread( input_file, frame + pcm->length / SAMPLES_PER_FRAME );
+}
+
+
+// Jump to a new position in the track, while carrying on playing
+void do_seek( float cuepoint )
+{
+	pcm_buffer_t *pcm = NULL;
+	unsigned long frame = 0;
+
+	if (verbose) printf("-> do_seek(%f)\n", cuepoint);
+	
+	// (rather than jumping back to the start of the track)
+	if (!(cuepoint >= 0.0f && cuepoint <= input_file->duration)) {
+		fprintf(stderr, "Warning: can't seek to %2.2f seconds, it is outside the track.\n", cuepoint);
+		return;
+	}
+	
+	playlist_cancel();
+
+	// Not playing - so just cue instead
+	if (get_state() != MADJACK_STATE_PLAYING) {
+		do_cue( cuepoint );
+		return;
+	}
+	
+	// Jumping out of a loop
+	stop_loop();
+	
+	// Carts are already in memory
+	if (cart_is_loaded()) {
+		cue_cart( cuepoint );
+		return;
+	}
+	
+	// Decode the new position into memory and switch over to it
+	// (which may reuse the buffer decoded for the transport)
+	located_pcm = NULL;
+	pcm = decode_seek_buffer( cuepoint, &frame );
+	if (pcm == NULL) {
+		fprintf(stderr, "Warning: failed to seek to %2.2f seconds.\n", cuepoint);
+		return;
+	}
+	
+	play_from_buffer( pcm, frame );
+}
+
+
+/*
+ * Follow the JACK transport to frame 'sample' of the track. If it is
+ * rolling, start playing there, lined up with the transport; if not,
+ * pause and decode the audio there, ready for when it starts.
+ */
+
+void do_locate( jack_nframes_t sample, int rolling )
+{
+	jack_nframes_t rate = jack_get_sample_rate( client );
+	float seconds = (float)sample / rate;
+	unsigned int fade = 0;
+	unsigned int offset = 0;
+
+	if (verbose) printf("-> do_locate(%u, %d)\n", sample, rolling);
+	playlist_cancel();
+
+	if (get_state() != MADJACK_STATE_PLAYING &&
+	    get_state() != MADJACK_STATE_PAUSED &&
+	    get_state() != MADJACK_STATE_READY &&
+	    get_state() != MADJACK_STATE_STOPPED)
+	{
+		return;
+	}
+	
+	// Transport has gone past the end of the track
+	if (seconds >= input_file->duration) {
+		located_pcm = NULL;
+		do_stop();
+		return;
+	}
+	
+	stop_loop();
+	
+	if (cart_is_loaded()) {
+		// Carts are already in memory
+		if (rolling) seconds = (float)jack_get_current_transport_frame( client ) / rate;
+		cue_cart( seconds );
+		set_state( rolling ? MADJACK_STATE_PLAYING : MADJACK_STATE_PAUSED );
+		return;
+	}
+	
+	// Use the audio decoded when the transport stopped here, or decode it now
+	if (located_pcm == NULL || located_sample != sample) {
+		located_pcm = decode_seek_buffer( seconds, &located_frame );
+		located_sample = sample;
+		if (located_pcm == NULL) {
+			fprintf(stderr, "Warning: failed to follow transport to %2.2f seconds.\n", seconds);
+			do_stop();
+			return;
+		}
+	}
+	
+	if (!rolling) {
+		// Wait for the transport to start
+		if (get_state() == MADJACK_STATE_PLAYING)
+			set_state( MADJACK_STATE_PAUSED );
+		input_file->position = seconds;
+		return;
+	}
+	
+	// Crossfade if we are already playing
+	if (get_state() == MADJACK_STATE_PLAYING)
+		fade = OVERLAY_CROSSFADE_LEN * rate;
+	
+	// Start at the exact sample, with the transport
+	if (sample > located_frame * SAMPLES_PER_FRAME)
+		offset = sample - located_frame * SAMPLES_PER_FRAME;
+	start_overlay_synced( located_pcm, offset, fade, sample );
+	input_file->position = seconds;
+	play_when_ready = 0;
+	set_state( MADJACK_STATE_PLAYING );
+	
+	// Restart the decoder after the buffer
+	wait_for_overlay_start();
+	restart_decoder_thread( input_file, located_frame + located_pcm->length / SAMPLES_PER_FRAME );
+	located_pcm = NULL;
+}
+
+
+// Play a region of the track over and over again
+// (with a crossfade of 'fade' seconds at the seam)
+void do_loop( float start, float end, float fade )
+{
+	jack_nframes_t rate = jack_get_sample_rate( client );
+	unsigned int entry_fade = 0;
+	pcm_buffer_t *pcm = NULL;
+
+	if (verbose) printf("-> do_loop(%f, %f, %f)\n", start, end, fade);
+	playlist_cancel();
+
+	if (get_state() != MADJACK_STATE_PLAYING &&
+	    get_state() != MADJACK_STATE_PAUSED &&
+	    get_state() != MADJACK_STATE_READY &&
+	    get_state() != MADJACK_STATE_STOPPED)
+	{
+		fprintf(stderr, "Warning: Can't loop in state %s.\n", get_state_name(get_state()) );
+		return;
+	}
+	
+	if (start < 0.0f) start = 0.0f;
+	if (fade < 0.0f) fade = 0.0f;
+	if (end <= start) {
+		fprintf(stderr, "Warning: end of loop must be after the start.\n");
+		return;
+	}
+	
+	// Not playing - cue up the start of the loop
+	if (get_state() != MADJACK_STATE_PLAYING) {
+		do_cue( start );
+		if (get_state() == MADJACK_STATE_ERROR) return;
+	}
+
+	// Decode the loop into memory
+	pcm = decode_loop_buffer( start, end );
+	if (pcm == NULL) {
+		fprintf(stderr, "Warning: failed to decode loop from %2.2f to %2.2f seconds.\n", start, end);
+		return;
+	}
+	
+	// Crossfade if we are already playing from the ringbuffer
+	if (get_state() == MADJACK_STATE_PLAYING && !loop_is_active() &&
+	    !cart_is_loaded() && !overlay_is_active())
+		entry_fade = OVERLAY_CROSSFADE_LEN * rate;
+	
+	start_loop( pcm, start, fade * rate, entry_fade );
+	wait_for_loop_start();
+}
+
+
+// Carry on playing past the end of the loop
+void do_unloop()
+{
+	pcm_buffer_t *pcm = NULL;
+	unsigned long frame = 0;
+	float end;
+
+	if (verbose) printf("-> do_unloop()\n");
+
+	if (!loop_is_active()) {
+		fprintf(stderr, "Warning: deck isn't looping.\n");
+		return;
+	}
+	end = get_loop_end();
+	
+	// Not playing - cue up the end of the loop
+	if (get_state() != MADJACK_STATE_PLAYING) {
+		stop_loop();
+		do_cue( end );
+		return;
+	}
+	
+	if (cart_is_loaded()) {
+		// Carts are already in memory
+		cue_cart( end );
+	} else {
+		unsigned int offset = 0;
+		long sample;
+	
+		// Decode the audio after the loop, and restart the decoder after that,
+		// while the callback is still playing the loop
+		located_pcm = NULL;
+		pcm = decode_seek_buffer( end, &frame );
+		if (pcm == NULL) {
+			fprintf(stderr, "Warning: failed to decode audio after the loop.\n");
+			return;
+		}
+		
+		sample = lrintf( end * jack_get_sample_rate( client ) ) - frame * SAMPLES_PER_FRAME;
+		if (sample > 0) offset = sample;
+		
+		start_overlay( pcm, offset, 0 );
+		restart_decoder_thread( input_file, frame + pcm->length / SAMPLES_PER_FRAME );
+	}
+	
+	// Let the current pass finish
+	exit_loop();
+}
+
+
+// Set a hot cue (and decode the audio after it)
+void do_set_hotcue( int index, float cuepoint )
+{
+	if (verbose) printf("-> do_set_hotcue(%d, %f)\n", index, cuepoint);
+
+	if (get_state() == MADJACK_STATE_EMPTY ||
+	    get_state() == MADJACK_STATE_ERROR)
+	{
+		fprintf(stderr, "Warning: Can't set hot cue in state %s.\n", get_state_name(get_state()) );
+		return;
+	}
+	
+	set_hotcue( index, cuepoint );
+}
+
+
+// Start playing from a hot cue
+void do_fire_hotcue( int index )
+{
+	hotcue_t *hotcue = get_hotcue( index );
+
+	if (verbose) printf("-> do_fire_hotcue(%d)\n", index);
+	playlist_cancel();
+	
+	if (hotcue == NULL || !hotcue->set) {
+		fprintf(stderr, "Warning: hot cue %d has not been set.\n", index);
+		return;
+	}
+
+	if (get_state() != MADJACK_STATE_PLAYING &&
+	    get_state() != MADJACK_STATE_PAUSED &&
+	    get_state() != MADJACK_STATE_READY &&
+	    get_state() != MADJACK_STATE_LOADING &&
+	    get_state() != MADJACK_STATE_STOPPED)
+	{
+		fprintf(stderr, "Warning: Can't change from %s to state PLAYING.\n", get_state_name(get_state()) );
+		return;
+	}
+
+	// Jumping out of a loop
+	stop_loop();
+
+	if (cart_is_loaded()) {
+		// Carts are already in memory
+		cue_cart( hotcue->cuepoint );
+		set_state( MADJACK_STATE_PLAYING );
+	} else {
+		play_from_buffer( hotcue->preroll, hotcue->frame );
+	}
+}
+
+
 // Quit MadJack
 void do_quit()
 {
@@ -370,6 +768,19 @@ void display_keyhelp()
 }
 
 
+// Queue a command from the keyboard, behind any from OSC
+static
+void submit_keypress( command_type_t type, float cuepoint, const char* filepath )
+{
+	command_t cmd;
+	
+	command_init( &cmd, type );
+	cmd.value[0] = cuepoint;
+	if (filepath && command_set_name( &cmd, filepath )) return;
+	command_submit( &cmd );
+}
+
+
 static
 void read_keypress()
 {
@@ -384,28 +795,28 @@ void read_keypress()
 		// Pause/Play
 		case 'p': 
 			if (get_state() == MADJACK_STATE_PLAYING) {
-				do_pause();
+				submit_keypress( COMMAND_PAUSE, 0.0f, NULL );
 			} else {
-				do_play();
+				submit_keypress( COMMAND_PLAY, 0.0f, NULL );
 			}
 		break;
 		
 		// Load
 		case 'l': {
 			char* filepath = read_filepath();
-			do_load( filepath );
+			submit_keypress( COMMAND_LOAD, 0.0f, filepath );
 			free( filepath );
 			break;
 		}
 
-		case 'e': do_eject(); break;
-		case 's': do_stop(); break;
+		case 'e': submit_keypress( COMMAND_EJECT, 0.0f, NULL ); break;
+		case 's': submit_keypress( COMMAND_STOP, 0.0f, NULL ); break;
 		case 'q': do_quit(); break;
-		case 'c': do_cue(0.0f); break;
+		case 'c': submit_keypress( COMMAND_CUE, 0.0f, NULL ); break;
 
 		case 'C': {
 			float cuepoint = read_cuepoint();
-			do_cue( cuepoint );
+			submit_keypress( COMMAND_CUE, cuepoint, NULL );
 			break;
 		}
 		
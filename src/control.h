@@ -21,15 +21,24 @@
 */
 
 
+#include <jack/jack.h>
+
 #ifndef _CONTROL_H_
 #define _CONTROL_H_
 
-void do_load( const char* name );
+char* build_fullpath( const char* root, const char* name );
+void do_load( const char* name, int preload );
 void do_cue( float cuepoint );
+void do_seek( float cuepoint );
+void do_locate( jack_nframes_t sample, int rolling );
+void do_loop( float start, float end, float fade );
+void do_unloop();
 void do_play();
 void do_pause();
 void do_stop();
 void do_eject();
+void do_set_hotcue( int index, float cuepoint );
+void do_fire_hotcue( int index );
 void do_quit();
 
 void handle_keypresses();
@@ -0,0 +1,322 @@
+/*
+
+	group.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+
+#include <jack/jack.h>
+
+#include "madjack.h"
+#include "schedule.h"
+#include "group.h"
+#include "config.h"
+
+
+/*
+ * Decks (in the same or separate processes, on the same JACK server)
+ * can be armed as part of a named group. A /group/play sent to any
+ * one deck picks a JACK frame time a few periods ahead and writes it
+ * into a small shared memory page for the group. Each armed deck
+ * checks the page at the start of every period, and schedules its
+ * start for that frame, so they all begin on the same sample.
+ *
+ * Decks record the frame they actually started at in the page, so the
+ * spread between the earliest and latest start can be checked.
+ *
+ * Each armed deck holds a slot in the page with its process id, so that
+ * a deck that exits (or crashes) without disarming can be taken out.
+ */
+
+
+typedef struct mapped_group_struct {
+	char name[GROUP_MAX_NAME];
+	group_page_t *page;
+} mapped_group_t;
+
+
+// ------- Globals -------
+static mapped_group_t mapped[GROUP_MAX_MAPPED];	// Groups this deck has opened
+static unsigned int mapped_count = 0;
+
+static group_page_t * volatile armed_page = NULL;	// Page of the group we are armed in
+static const char *armed_name = NULL;			// Name of that group
+static unsigned int armed_slot = 0;				// Our slot in the page
+static unsigned int armed_generation = 0;		// Generation when we were armed
+static int triggered = 0;						// Set once our start is scheduled
+static unsigned long starts_before = 0;			// Scheduled starts before ours
+
+
+
+// Find (or create and map) the page for a group
+// Pages stay mapped until exit, as the JACK callback may be using them
+static
+mapped_group_t* open_group( const char* name )
+{
+	char segment[GROUP_MAX_NAME + sizeof(GROUP_SEGMENT_NAME)];
+	group_page_t *page;
+	struct stat st;
+	unsigned int i;
+	int fd;
+	
+	for (i=0; i<mapped_count; i++) {
+		if (strcmp( mapped[i].name, name ) == 0) return &mapped[i];
+	}
+	
+	if (strlen( name ) == 0 || strlen( name ) >= GROUP_MAX_NAME || strchr( name, '/' )) {
+		fprintf(stderr, "Warning: '%s' is not a valid group name.\n", name);
+		return NULL;
+	}
+	if (mapped_count >= GROUP_MAX_MAPPED) {
+		fprintf(stderr, "Warning: deck can't join more than %d groups.\n", GROUP_MAX_MAPPED);
+		return NULL;
+	}
+	
+	// Whoever opens it first makes it the right size (and zeros it)
+	snprintf( segment, sizeof(segment), GROUP_SEGMENT_NAME, name );
+	fd = shm_open( segment, O_RDWR|O_CREAT, 0644 );
+	if (fd < 0) {
+		perror("failed to open group page");
+		return NULL;
+	}
+	if (fstat( fd, &st ) || (st.st_size < sizeof(group_page_t) &&
+	                         ftruncate( fd, sizeof(group_page_t) ))) {
+		perror("failed to resize group page");
+		close( fd );
+		return NULL;
+	}
+	
+	page = mmap( NULL, sizeof(group_page_t), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	if (page == MAP_FAILED) {
+		perror("failed to map group page");
+		return NULL;
+	}
+	
+	strcpy( mapped[mapped_count].name, name );
+	mapped[mapped_count].page = page;
+	return &mapped[mapped_count++];
+}
+
+
+// Free the slots of decks that have gone away without disarming
+static
+void reap_dead_members( group_page_t *page )
+{
+	unsigned int i;
+	
+	for (i=0; i<GROUP_MAX_MEMBERS; i++) {
+		pid_t pid = page->armed[i];
+		if (pid && kill( pid, 0 ) && errno == ESRCH) {
+			__sync_bool_compare_and_swap( &page->armed[i], pid, 0 );
+		}
+	}
+}
+
+
+// Number of decks armed in a group
+static
+unsigned int count_armed( group_page_t *page )
+{
+	unsigned int i, count = 0;
+	
+	for (i=0; i<GROUP_MAX_MEMBERS; i++) {
+		if (page->armed[i]) count++;
+	}
+	
+	return count;
+}
+
+
+// Arm the deck to start with the rest of a group
+// Returns 0 on success
+int group_arm( const char* name )
+{
+	mapped_group_t *group = open_group( name );
+	unsigned int i;
+
+	if (verbose) printf("-> group_arm(%s)\n", name);
+	if (!group) return -1;
+	
+	group_disarm();
+	
+	if (get_state() != MADJACK_STATE_READY &&
+	    get_state() != MADJACK_STATE_PAUSED &&
+	    get_state() != MADJACK_STATE_LOADING &&
+	    !(get_state() == MADJACK_STATE_STOPPED && warm_stopped))
+	{
+		fprintf(stderr, "Warning: Can't arm deck while %s.\n", get_state_name(get_state()) );
+		return -1;
+	}
+	
+	// Take a free slot in the group
+	reap_dead_members( group->page );
+	for (i=0; i<GROUP_MAX_MEMBERS; i++) {
+		if (__sync_bool_compare_and_swap( &group->page->armed[i], 0, getpid() )) break;
+	}
+	if (i == GROUP_MAX_MEMBERS) {
+		fprintf(stderr, "Warning: group '%s' already has %d decks armed.\n", name, GROUP_MAX_MEMBERS);
+		return -1;
+	}
+	
+	armed_generation = group->page->generation;
+	armed_name = group->name;
+	armed_slot = i;
+	triggered = 0;
+	__sync_synchronize();
+	armed_page = group->page;
+	
+	return 0;
+}
+
+
+// Leave the group we are armed in (if any)
+void group_disarm()
+{
+	group_page_t *page = armed_page;
+	
+	// (the JACK callback may be leaving the group at the same time)
+	if (page && __sync_bool_compare_and_swap( &armed_page, page, NULL )) {
+		armed_name = NULL;
+		page->armed[armed_slot] = 0;
+	}
+}
+
+
+// Start all the decks armed in a group
+// If frame is 0, start a few periods from now
+int group_play( const char* name, jack_nframes_t frame )
+{
+	mapped_group_t *group = open_group( name );
+	group_page_t *page;
+	
+	if (verbose) printf("-> group_play(%s)\n", name);
+	if (!group) return -1;
+	page = group->page;
+	
+	if (frame == 0) {
+		frame = jack_frame_time( client ) + GROUP_LEAD_PERIODS * jack_get_buffer_size( client );
+	}
+	
+	page->started = 0;
+	page->start_frame = frame;
+	__sync_synchronize();
+	page->generation++;
+	
+	reap_dead_members( page );
+	if (!quiet) printf("Starting %u decks in group '%s' at frame %u.\n", count_armed( page ), name, frame);
+	
+	return 0;
+}
+
+
+// Record the frame we actually started at
+static
+void record_start( group_page_t *page, jack_nframes_t frame )
+{
+	jack_nframes_t old;
+
+	if (__sync_fetch_and_add( &page->started, 1 ) == 0) {
+		page->first_frame = frame;
+		page->last_frame = frame;
+		return;
+	}
+	
+	while ((int)(frame - (old = page->first_frame)) < 0 &&
+	       !__sync_bool_compare_and_swap( &page->first_frame, old, frame ));
+	while ((int)(frame - (old = page->last_frame)) > 0 &&
+	       !__sync_bool_compare_and_swap( &page->last_frame, old, frame ));
+}
+
+
+// Called at the start of each period by the JACK callback
+void group_process()
+{
+	group_page_t *page = armed_page;
+	jack_nframes_t frame;
+	
+	if (!page) return;
+	
+	if (!triggered) {
+		// Has the group been told to play ?
+		if (page->generation != armed_generation) {
+			__sync_synchronize();
+			starts_before = schedule_get_last_start( &frame );
+			schedule_start( page->start_frame );
+			triggered = 1;
+		}
+	} else if (schedule_get_last_start( &frame ) != starts_before) {
+		// Our audio has started
+		record_start( page, frame );
+		group_disarm();
+	} else if (!schedule_start_pending()) {
+		// Start was dropped (nothing loaded to play), so leave the group
+		// rather than staying armed and triggered for good
+		group_disarm();
+	}
+}
+
+
+// Get the state of a group
+// Returns 0 on success
+int group_get_state( const char* name, unsigned int *armed,
+                     unsigned int *started, jack_nframes_t *spread )
+{
+	mapped_group_t *group = open_group( name );
+	
+	if (!group) return -1;
+	
+	reap_dead_members( group->page );
+	*armed = count_armed( group->page );
+	*started = group->page->started;
+	*spread = *started ? group->page->last_frame - group->page->first_frame : 0;
+	
+	return 0;
+}
+
+
+// Name of the group this deck is armed in (or NULL)
+const char* group_get_armed()
+{
+	return armed_name;
+}
+
+
+void finish_group()
+{
+	unsigned int i;
+	
+	group_disarm();
+	
+	for (i=0; i<mapped_count; i++) {
+		munmap( mapped[i].page, sizeof(group_page_t) );
+	}
+	mapped_count = 0;
+}
+
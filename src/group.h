@@ -0,0 +1,59 @@
+/*
+
+	group.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "madjack.h"
+
+#ifndef _GROUP_H_
+#define _GROUP_H_
+
+
+// Constants
+#define GROUP_SEGMENT_NAME		"/madjack-group-%s"
+#define GROUP_MAX_NAME			(64)		// Longest group name
+#define GROUP_MAX_MAPPED		(8)			// Most groups one deck can have joined
+#define GROUP_MAX_MEMBERS		(32)		// Most decks that can be armed in a group at once
+#define GROUP_LEAD_PERIODS		(3)			// Periods between /group/play and the start
+
+
+// Page shared by the decks in a group
+typedef struct group_page_struct {
+	volatile unsigned int generation;	// Incremented by each /group/play
+	volatile jack_nframes_t start_frame;	// JACK frame time to start at
+	volatile pid_t armed[GROUP_MAX_MEMBERS];	// Processes of the decks waiting to start (0 if free)
+	volatile unsigned int started;		// Number of decks that have started
+	volatile jack_nframes_t first_frame;	// Earliest frame a deck started at
+	volatile jack_nframes_t last_frame;	// Latest frame a deck started at
+} group_page_t;
+
+
+// Prototypes
+int group_arm( const char* name );
+void group_disarm();
+int group_play( const char* name, jack_nframes_t frame );
+void group_process();
+int group_get_state( const char* name, unsigned int *armed,
+                     unsigned int *started, jack_nframes_t *spread );
+const char* group_get_armed();
+void finish_group();
+
+#endif
@@ -0,0 +1,153 @@
+/*
+
+	hotcue.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <jack/jack.h>
+
+#include "madjack.h"
+#include "maddecode.h"
+#include "pcmbuffer.h"
+#include "preload.h"
+#include "overlay.h"
+#include "cart.h"
+#include "hotcue.h"
+#include "config.h"
+
+
+// ------- Globals -------
+static hotcue_t hotcues[MAX_HOTCUES];
+
+
+
+/*
+ * Set a hot cue, and decode the audio that follows it into memory,
+ * so that playback can start from it without waiting for the decoder.
+ *
+ * Returns 1 on success, 0 on failure.
+ */
+
+int set_hotcue( unsigned int index, float cuepoint )
+{
+	hotcue_t *hotcue = get_hotcue( index );
+	FILE* file = NULL;
+	int at_eof = 0;
+	
+	if (hotcue == NULL) {
+		fprintf(stderr, "Warning: hot cue %u is out of range.\n", index);
+		return 0;
+	}
+	
+	// (the duration isn't known until the track has started loading)
+	if (!(cuepoint >= 0.0f) ||
+	    (input_file->duration > 0.0f && cuepoint > input_file->duration)) {
+		fprintf(stderr, "Warning: hot cue %u at %2.2f seconds is outside the track.\n", index, cuepoint);
+		return 0;
+	}
+	
+	hotcue->set = 0;
+	hotcue->cuepoint = cuepoint;
+	
+	// Carts are already in memory
+	if (cart_is_loaded()) {
+		hotcue->set = 1;
+		return 1;
+	}
+	
+	// Need the bitrate etc. to work out where the cuepoint is
+	if (input_file->framesize == 0) {
+		fprintf(stderr, "Warning: can't set hot cue until the track has started loading.\n");
+		return 0;
+	}
+	hotcue->frame = cuepoint_to_frame( input_file, cuepoint );
+	
+	// Allocate the pre-roll buffer
+	if (hotcue->preroll == NULL) {
+		hotcue->preroll = init_pcm_buffer( HOTCUE_PREROLL_FRAMES * SAMPLES_PER_FRAME );
+	}
+	
+	// Don't overwrite the buffer while it is being played
+	while (overlay_is_using( hotcue->preroll )) usleep(1000);
+	
+	// Decode using a file handle of our own
+	file = reopen_input_file( input_file );
+	if (file == NULL) {
+		fprintf(stderr, "Warning: failed to open file to decode hot cue.\n");
+		return 0;
+	}
+	
+	if (decode_to_buffer( input_file, file, hotcue->frame, hotcue->preroll, &at_eof ) > 0) {
+		hotcue->set = 1;
+		if (verbose) printf("Set hot cue %u at %2.2f seconds.\n", index, cuepoint);
+	}
+	fclose( file );
+	
+	return hotcue->set;
+}
+
+
+hotcue_t* get_hotcue( unsigned int index )
+{
+	if (index >= MAX_HOTCUES) return NULL;
+	return &hotcues[index];
+}
+
+
+// Forget all the hot cues (when a new track is loaded)
+void clear_hotcues()
+{
+	int i;
+	
+	for (i=0; i<MAX_HOTCUES; i++) {
+		hotcues[i].set = 0;
+		if (hotcues[i].preroll) hotcues[i].preroll->length = 0;
+	}
+}
+
+
+void finish_hotcues()
+{
+	int i;
+	
+	for (i=0; i<MAX_HOTCUES; i++) {
+		finish_pcm_buffer( hotcues[i].preroll );
+		hotcues[i].preroll = NULL;
+		hotcues[i].set = 0;
+	}
+}
+
+
+unsigned long hotcue_memory_usage()
+{
+	unsigned long total = 0;
+	int i;
+	
+	for (i=0; i<MAX_HOTCUES; i++) {
+		total += pcm_buffer_bytes( hotcues[i].preroll );
+	}
+	
+	return total;
+}
+
@@ -0,0 +1,50 @@
+/*
+
+	hotcue.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "madjack.h"
+
+#ifndef _HOTCUE_H_
+#define _HOTCUE_H_
+
+
+// Constants
+#define MAX_HOTCUES				(8)
+#define HOTCUE_PREROLL_FRAMES	(40)		// MPEG Audio frames (about a second)
+
+
+typedef struct hotcue_struct {
+	int set;							// Hot cue has been set
+	float cuepoint;						// Cuepoint (in seconds)
+	unsigned long frame;				// MPEG Audio frame the cuepoint is in
+	pcm_buffer_t *preroll;				// Decoded audio from the cuepoint onwards
+} hotcue_t;
+
+
+// Prototypes
+int set_hotcue( unsigned int index, float cuepoint );
+hotcue_t* get_hotcue( unsigned int index );
+void clear_hotcues();
+void finish_hotcues();
+unsigned long hotcue_memory_usage();
+
+#endif
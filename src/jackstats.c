@@ -0,0 +1,187 @@
+/*
+
+	jackstats.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <jack/jack.h>
+#include <jack/ringbuffer.h>
+
+#include "madjack.h"
+#include "rbsize.h"
+#include "jackstats.h"
+#include "config.h"
+
+
+/*
+ * Keeps track of what JACK tells us about the graph we are part of:
+ * the latency between our output ports and the speakers, the period
+ * size (which sets the least audio the ringbuffer has to hold), and
+ * every xrun, along with what the deck was doing at the time and how
+ * much decoded audio was waiting in the ringbuffer.
+ *
+ * If most xruns happen with a near-empty ringbuffer, the decoder is
+ * not keeping up; if they happen with plenty buffered, the problem is
+ * elsewhere in the graph.
+ */
+
+
+// ------- Globals -------
+static jack_nframes_t latency_min = 0;		// Least frames between our outputs and playback
+static jack_nframes_t latency_max = 0;		// Most frames between our outputs and playback
+static jack_nframes_t period = 0;			// Frames in each JACK period
+
+static unsigned long xruns_total = 0;				// Number of xruns seen
+static unsigned long xruns_in_state[MADJACK_STATE_QUIT+1];	// Number of xruns in each deck state
+static unsigned long xruns_low_fill = 0;			// Xruns with the ringbuffer nearly empty
+static float xrun_min_fill = 0.0f;					// Lowest fill at an xrun (in seconds)
+static float xrun_max_delay = 0.0f;					// Longest delay reported (in microseconds)
+static enum madjack_state xrun_last_state = MADJACK_STATE_STARTING;	// State at last xrun
+
+
+
+#ifdef HAVE_JACK_SET_LATENCY_CALLBACK
+// Called by JACK when the latency of the graph has changed
+static
+void latency_callback_jack( jack_latency_callback_mode_t mode, void *arg )
+{
+	jack_latency_range_t range;
+	int c;
+	
+	if (mode == JackPlaybackLatency) {
+		jack_nframes_t min = 0, max = 0;
+		
+		// How long until what we output is heard
+		for (c=0; c<2; c++) {
+			jack_port_get_latency_range( outport[c], JackPlaybackLatency, &range );
+			if (c==0 || range.min < min) min = range.min;
+			if (c==0 || range.max > max) max = range.max;
+		}
+		
+		if (verbose && (min != latency_min || max != latency_max)) {
+			printf("Output latency is now %u to %u frames.\n", min, max);
+		}
+		latency_min = min;
+		latency_max = max;
+	} else {
+		// Audio is decoded from a file, so none of it is captured
+		range.min = range.max = 0;
+		for (c=0; c<2; c++) {
+			jack_port_set_latency_range( outport[c], JackCaptureLatency, &range );
+		}
+	}
+}
+#endif
+
+
+// Called by JACK when the period size changes
+static
+int buffer_size_callback_jack( jack_nframes_t nframes, void *arg )
+{
+	size_t needed = JACKSTATS_MIN_PERIODS * nframes * sizeof(float);
+	
+	if (verbose && nframes != period) printf("JACK period is now %u frames.\n", nframes);
+	period = nframes;
+	
+	// Keep several periods of audio in the ringbuffer
+	rbsize_set_period( nframes );
+	if (ringbuffer[0]->size < needed) {
+		fprintf(stderr, "Warning: ringbuffer holds less than %d periods of %u frames; "
+		                "increase it with -r.\n", JACKSTATS_MIN_PERIODS, nframes );
+	}
+	
+	return 0;
+}
+
+
+// Called by JACK (not in the process thread) after an xrun
+static
+int xrun_callback_jack( void *arg )
+{
+	enum madjack_state state = get_state();
+	size_t bytes_per_sec = jack_get_sample_rate( client ) * sizeof(float);
+	size_t fill = jack_ringbuffer_read_space( ringbuffer[0] );
+	float fill_secs = (float)fill / bytes_per_sec;
+	float delay = jack_get_xrun_delayed_usecs( client );
+	
+	if (xruns_total == 0 || fill_secs < xrun_min_fill) xrun_min_fill = fill_secs;
+	if (delay > xrun_max_delay) xrun_max_delay = delay;
+	if (fill < ringbuffer[0]->size * JACKSTATS_LOW_FILL) xruns_low_fill++;
+	if (state >= 0 && state <= MADJACK_STATE_QUIT) xruns_in_state[state]++;
+	xrun_last_state = state;
+	xruns_total++;
+	
+	if (verbose) printf("Xrun while %s with %2.2f seconds in the ringbuffer (delayed %2.2f ms).\n",
+	                    get_state_name( state ), fill_secs, delay / 1000.0f);
+	
+	return 0;
+}
+
+
+void jackstats_get_latency( jack_nframes_t *min, jack_nframes_t *max, jack_nframes_t *frames )
+{
+	*min = latency_min;
+	*max = latency_max;
+	*frames = period;
+}
+
+
+void jackstats_get_xruns( unsigned long *total, unsigned long *playing,
+                          unsigned long *low_fill, float *min_fill, float *max_delay,
+                          const char **last_state )
+{
+	*total = xruns_total;
+	*playing = xruns_in_state[MADJACK_STATE_PLAYING];
+	*low_fill = xruns_low_fill;
+	*min_fill = xrun_min_fill;
+	*max_delay = xrun_max_delay / 1000.0f;
+	*last_state = xruns_total ? get_state_name( xrun_last_state ) : "";
+}
+
+
+void init_jackstats()
+{
+	// Start with the current period size
+	period = jack_get_buffer_size( client );
+	rbsize_set_period( period );
+	
+	jack_set_buffer_size_callback( client, buffer_size_callback_jack, NULL );
+	jack_set_xrun_callback( client, xrun_callback_jack, NULL );
+#ifdef HAVE_JACK_SET_LATENCY_CALLBACK
+	jack_set_latency_callback( client, latency_callback_jack, NULL );
+#endif
+}
+
+
+void finish_jackstats()
+{
+	int s;
+	
+	if (quiet || xruns_total == 0) return;
+	
+	printf("There were %lu xruns (%lu with the ringbuffer nearly empty):", xruns_total, xruns_low_fill);
+	for (s=0; s<=MADJACK_STATE_QUIT; s++) {
+		if (xruns_in_state[s]) printf(" %s=%lu", get_state_name( s ), xruns_in_state[s]);
+	}
+	printf("\n");
+}
+
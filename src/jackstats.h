@@ -0,0 +1,43 @@
+/*
+
+	jackstats.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include <jack/jack.h>
+
+#ifndef _JACKSTATS_H_
+#define _JACKSTATS_H_
+
+
+// Constants
+#define JACKSTATS_MIN_PERIODS	(8)			// Warn if ringbuffer holds fewer periods than this
+#define JACKSTATS_LOW_FILL		(0.25f)		// Xruns below this fraction of the ringbuffer are 'low'
+
+
+// Prototypes
+void init_jackstats();
+void finish_jackstats();
+void jackstats_get_latency( jack_nframes_t *min, jack_nframes_t *max, jack_nframes_t *period );
+void jackstats_get_xruns( unsigned long *total, unsigned long *playing,
+                          unsigned long *low_fill, float *min_fill, float *max_delay,
+                          const char **last_state );
+
+#endif
@@ -0,0 +1,317 @@
+/*
+
+	loop.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "madjack.h"
+#include "maddecode.h"
+#include "pcmbuffer.h"
+#include "preload.h"
+#include "overlay.h"
+#include "cart.h"
+#include "loop.h"
+#include "config.h"
+
+
+/*
+ * A loop is a region of the track, decoded into memory, which the
+ * JACK callback plays over and over again until told to exit.
+ *
+ * If there is a seam crossfade, the last 'fade' frames of the region
+ * are mixed with the first 'fade' frames, and each pass after the
+ * first one starts 'fade' frames into the region.
+ *
+ * When exiting, the current pass is played to the end of the region
+ * without the seam, and then the callback carries on with whatever
+ * follows (the overlay or the cart), which has been cued to the end.
+ */
+
+
+// ------- Globals -------
+static pcm_buffer_t *loop_buffer[LOOP_BUFFERS];	// Memory that loops are decoded into
+static pcm_buffer_t *loop_pcm = NULL;			// Audio of the loop that is playing
+static float loop_start = 0.0f;				// Position of the loop in the track (in seconds)
+static unsigned int loop_position = 0;		// Read position in the loop (in frames)
+static unsigned int loop_fade = 0;			// Frames to crossfade at the seam
+static unsigned int loop_entry_fade = 0;	// Frames to crossfade from the ringbuffer
+static int loop_entered = 0;				// Set once the first pass is over
+static int loop_exiting = 0;				// Set to stop at the end of this pass
+static int loop_active = 0;					// Set while the callback is playing the loop
+
+
+
+/*
+ * Decode the audio between two points in the track into memory
+ * (snapped to the nearest sample).
+ *
+ * Returns the buffer, or NULL on failure.
+ */
+
+pcm_buffer_t* decode_loop_buffer( float start, float end )
+{
+	jack_nframes_t rate = jack_get_sample_rate( client );
+	unsigned long begin_sample, end_sample;
+	pcm_buffer_t *pcm = NULL;
+	unsigned int length;
+	unsigned int offset = 0;
+	int c, i;
+	
+	// (also catches NaN)
+	if (!(start >= 0.0f && end > start) || start > input_file->duration) return NULL;
+	if (end - start > LOOP_MAX_SECONDS) {
+		fprintf(stderr, "Warning: loops can't be longer than %2.0f seconds.\n", LOOP_MAX_SECONDS);
+		return NULL;
+	}
+	
+	begin_sample = lrintf( start * rate );
+	end_sample = lrintf( end * rate );
+	length = end_sample - begin_sample;
+	if (end_sample <= begin_sample) return NULL;
+
+	// Use a buffer that isn't being played
+	for (i=0; i<LOOP_BUFFERS; i++) {
+		if (loop_buffer[i] != loop_pcm || !loop_active) {
+			pcm = loop_buffer[i];
+			break;
+		}
+	}
+	
+	if (cart_is_loaded()) {
+		pcm_buffer_t *cart = get_cart_pcm();
+		
+		// Carts are already in memory
+		if (begin_sample >= cart->length) return NULL;
+		if (end_sample > cart->length) length = cart->length - begin_sample;
+		offset = begin_sample;
+
+		if (pcm == NULL || pcm->capacity != length) {
+			finish_pcm_buffer( pcm );
+			pcm = init_pcm_buffer( length );
+		}
+		for (c=0; c<2; c++) {
+			memcpy( pcm->samples[c], cart->samples[c] + offset, length * sizeof(float) );
+		}
+		pcm->length = length;
+		
+	} else {
+		unsigned long frame = begin_sample / SAMPLES_PER_FRAME;
+		FILE* file = NULL;
+		int at_eof = 0;
+		long samples;
+		
+		// Decode whole MPEG Audio frames, starting before the loop
+		offset = begin_sample - frame * SAMPLES_PER_FRAME;
+		// (the buffer is the exact size, so decoding stops at the end)
+		if (pcm == NULL || pcm->capacity != offset + length) {
+			finish_pcm_buffer( pcm );
+			pcm = init_pcm_buffer( offset + length );
+		}
+		
+		file = reopen_input_file( input_file );
+		if (file == NULL) {
+			fprintf(stderr, "Warning: failed to open file to decode loop.\n");
+			loop_buffer[i] = pcm;
+			return NULL;
+		}
+		
+		samples = decode_to_buffer( input_file, file, frame, pcm, &at_eof );
+		fclose( file );
+		
+		if (samples <= (long)offset) {
+			loop_buffer[i] = pcm;
+			return NULL;
+		}
+		
+		// Move the start of the loop to the start of the buffer
+		for (c=0; c<2; c++) {
+			memmove( pcm->samples[c], pcm->samples[c] + offset, (samples - offset) * sizeof(float) );
+		}
+		pcm->length = samples - offset;
+	}
+	
+	loop_buffer[i] = pcm;
+	return pcm;
+}
+
+
+// Make the callback start playing a loop next
+void start_loop( pcm_buffer_t *pcm, float start, unsigned int fade, unsigned int entry_fade )
+{
+	loop_active = 0;
+	__sync_synchronize();
+	
+	loop_pcm = pcm;
+	loop_start = start;
+	loop_position = 0;
+	loop_entered = 0;
+	loop_exiting = 0;
+	
+	// The seam can't be more than half of the loop
+	loop_fade = fade;
+	if (loop_fade > pcm->length / 2) loop_fade = pcm->length / 2;
+	loop_entry_fade = entry_fade;
+	if (loop_entry_fade > pcm->length) loop_entry_fade = pcm->length;
+	
+	__sync_synchronize();
+	loop_active = (pcm->length > 0);
+}
+
+
+// Wait until the callback has finished fading into the loop
+// (so that it is no longer reading the ringbuffer)
+void wait_for_loop_start()
+{
+	int i;
+	
+	for (i=0; i<100 && loop_active && !loop_entered &&
+	     (loop_position == 0 || loop_position < loop_entry_fade); i++) {
+		usleep(1000);
+	}
+}
+
+
+// Finish the current pass of the loop, then carry on
+void exit_loop()
+{
+	loop_exiting = 1;
+}
+
+
+void stop_loop()
+{
+	loop_active = 0;
+}
+
+
+int loop_is_active()
+{
+	return loop_active;
+}
+
+
+// Position of the loop in the track (in seconds)
+float get_loop_position()
+{
+	return loop_start + ((float)loop_position / jack_get_sample_rate( client ));
+}
+
+
+// Position of the end of the loop in the track (in seconds)
+float get_loop_end()
+{
+	return loop_start + ((float)loop_pcm->length / jack_get_sample_rate( client ));
+}
+
+
+// Copy audio for one channel from the loop into a JACK buffer
+// Returns the number of frames copied (less than asked for, when exiting)
+unsigned int read_loop( unsigned int channel, float* buffer, unsigned int nframes )
+{
+	const float *samples = loop_pcm->samples[channel];
+	unsigned int length = loop_pcm->length;
+	unsigned int seam = length - loop_fade;
+	unsigned int pos = loop_position;
+	unsigned int done = 0;
+	
+	if (pos > length) pos = length;
+	
+	while (done < nframes && pos < length) {
+		unsigned int len = nframes - done;
+		unsigned int i;
+		
+		if (pos < seam || loop_exiting) {
+			// Straight copy up to the seam
+			unsigned int stop = loop_exiting ? length : seam;
+			if (len > stop - pos) len = stop - pos;
+			memcpy( buffer + done, samples + pos, len * sizeof(float) );
+		} else {
+			// Equal power crossfade with the start of the loop
+			if (len > length - pos) len = length - pos;
+			for (i=0; i<len; i++) {
+				float t = (float)(pos + i - seam) / loop_fade;
+				buffer[done+i] = samples[pos+i] * sqrtf( 1.0f - t )
+				               + samples[pos+i-seam] * sqrtf( t );
+			}
+		}
+		
+		done += len;
+		pos += len;
+		
+		// Go round again, after the part that was crossfaded
+		if (pos == length && !loop_exiting) pos = loop_fade;
+	}
+	
+	// Fade out the old audio from the ringbuffer
+	if (!loop_entered && loop_position < loop_entry_fade) {
+		crossfade_from_ringbuffer( channel, buffer, done, loop_position, loop_entry_fade );
+	}
+	
+	return done;
+}
+
+
+// Move playback position on, once all channels have been read
+void advance_loop( unsigned int nframes )
+{
+	unsigned int length = loop_pcm->length;
+	
+	loop_position += nframes;
+	if (loop_exiting) {
+		if (loop_position >= length) {
+			loop_position = length;
+			loop_active = 0;
+		}
+	} else if (loop_position >= length) {
+		loop_position = loop_fade + (loop_position - length) % (length - loop_fade);
+		loop_entered = 1;
+	}
+}
+
+
+void finish_loop()
+{
+	int i;
+	
+	stop_loop();
+	for (i=0; i<LOOP_BUFFERS; i++) {
+		finish_pcm_buffer( loop_buffer[i] );
+		loop_buffer[i] = NULL;
+	}
+	loop_pcm = NULL;
+}
+
+
+unsigned long loop_memory_usage()
+{
+	unsigned long total = 0;
+	int i;
+	
+	for (i=0; i<LOOP_BUFFERS; i++) {
+		total += pcm_buffer_bytes( loop_buffer[i] );
+	}
+	
+	return total;
+}
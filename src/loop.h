@@ -0,0 +1,49 @@
+/*
+
+	loop.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "madjack.h"
+
+#ifndef _LOOP_H_
+#define _LOOP_H_
+
+
+// Constants
+#define LOOP_BUFFERS		(2)			// One playing, one being decoded into
+#define LOOP_MAX_SECONDS	(60.0)		// Longest loop that will be decoded into memory
+
+
+// Prototypes
+pcm_buffer_t* decode_loop_buffer( float start, float end );
+void start_loop( pcm_buffer_t *pcm, float start, unsigned int fade, unsigned int entry_fade );
+void wait_for_loop_start();
+void exit_loop();
+void stop_loop();
+int loop_is_active();
+float get_loop_position();
+float get_loop_end();
+unsigned int read_loop( unsigned int channel, float* buffer, unsigned int nframes );
+void advance_loop( unsigned int nframes );
+void finish_loop();
+unsigned long loop_memory_usage();
+
+#endif
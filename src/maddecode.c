@@ -33,6 +33,10 @@
 
 #include "madjack.h"
 #include "maddecode.h"
+#include "readahead.h"
+#include "rbsize.h"
+#include "rtsched.h"
+#include "status.h"
 #include "config.h"
 
 
@@ -68,7 +72,7 @@ enum mad_flow callback_input(void *data,
 	}
 
 	// At end of file ?
-	if (feof(input->file)) {
+	if (readahead_is_running() ? readahead_at_eof() : feof(input->file)) {
 		// Before we have filled the ringbuffer ?
 		if (get_state()==MADJACK_STATE_LOADING) {
 			// Anything in the ringbuffer ?
@@ -94,7 +98,13 @@ enum mad_flow callback_input(void *data,
 	}
 
 	// Read in some bytes
-	input->buffer_used += fread( input->buffer + input->buffer_used, 1, input->buffer_size - input->buffer_used, input->file);
+	if (readahead_is_running()) {
+		input->buffer_used += readahead_read( input->buffer + input->buffer_used, input->buffer_size - input->buffer_used );
+	} else {
+		unsigned long long start = get_usecs();
+		input->buffer_used += fread( input->buffer + input->buffer_used, 1, input->buffer_size - input->buffer_used, input->file);
+		record_read_latency( get_usecs() - start );
+	}
 
 	// Pass the buffer to libmad	
 	mad_stream_buffer(stream, input->buffer, input->buffer_used);
@@ -115,18 +125,28 @@ enum mad_flow callback_output(void *data,
 		     struct mad_header const *header,
 		     struct mad_pcm *pcm)
 {
+	input_file_t *input = data;
 	unsigned int nsamples;
 	mad_fixed_t const *left_ch, *right_ch;
 	
+	// Frame was only decoded to fill the bit reservoir ?
+	if (input->skip_frames) {
+		input->skip_frames--;
+		return MAD_FLOW_CONTINUE;
+	}
+	
 	// pcm->samplerate contains the sampling frequency
 	nsamples  = pcm->length;
 	left_ch   = pcm->samples[0];
 	right_ch  = pcm->samples[1];
 
 	
+	// Keep track of how well we are keeping up
+	rbsize_before_output();
+	rtsched_watch_fill( jack_ringbuffer_read_space( ringbuffer[0] ) );
+	
 	// Sleep until there is room in the ring buffer
-	while( jack_ringbuffer_write_space( ringbuffer[0] )
-	          < (nsamples * sizeof(float) ) )
+	while( rbsize_is_full( nsamples * sizeof(float) ) )
 	{
 		// Abort thread ?
 		if (terminate_decoder_thread)
@@ -138,7 +158,8 @@ enum mad_flow callback_output(void *data,
 			set_state( MADJACK_STATE_READY );
 		}
 		
-		usleep(1000);
+		// Don't hold up JACK when it is running flat out
+		usleep( freewheeling ? 100 : 1000 );
 	}
 
 
@@ -154,6 +175,7 @@ enum mad_flow callback_output(void *data,
 		if (pcm->channels == 2) sample = mad_f_todouble(*right_ch++);
 		jack_ringbuffer_write( ringbuffer[1], (char*)&sample, sizeof(sample) );
 	}
+	rbsize_after_output();
 
 	
 	
@@ -167,20 +189,23 @@ enum mad_flow callback_output(void *data,
  */
 
 static
-enum mad_flow callback_header(void *data,
+enum mad_flow parse_header( input_file_t *input,
 		struct mad_header const *header)
 {
-	input_file_t *input = data;
 	static int warned_vbr;
 	
-	// Abort thread ?
-	if (terminate_decoder_thread)
-		return MAD_FLOW_STOP;
-
 	//printf("samplerate of file: %d\n", header->samplerate);
-	if (jack_get_sample_rate( client ) != header->samplerate) {
-		error_handler( "Sample rate of input file (%d) is different to JACK's (%d)", 
-						header->samplerate, jack_get_sample_rate( client ) );
+	if (client && jack_get_sample_rate( client ) != header->samplerate) {
+		if (input == input_file) {
+			error_handler( "Sample rate of input file (%d) is different to JACK's (%d)", 
+							header->samplerate, jack_get_sample_rate( client ) );
+		} else {
+			// A queued track that isn't playing yet
+			// (the playlist looks at the sample rate to decide whether to skip it)
+			fprintf(stderr, "Warning: sample rate of %s (%d) is different to JACK's (%d)\n",
+			        input->filepath, header->samplerate, jack_get_sample_rate( client ) );
+			input->samplerate = header->samplerate;
+		}
 		
 		return MAD_FLOW_BREAK;
 	} else {
@@ -212,8 +237,9 @@ enum mad_flow callback_header(void *data,
 	// Calculate duration?
 	if (input->duration==0) {
 		int frames = (input->end_pos - input->start_pos) / input->framesize;
-		input->duration = (1152.0f * frames) / header->samplerate;
+		input->duration = ((float)SAMPLES_PER_FRAME * frames) / header->samplerate;
 		if (verbose) printf( "Duration: %2.2f seconds.\n", input->duration );
+		if (input == input_file) status_update( 1 );
 	}
 	
 	// Header looks OK
@@ -221,6 +247,20 @@ enum mad_flow callback_header(void *data,
 }
 
 
+static
+enum mad_flow callback_header(void *data,
+		struct mad_header const *header)
+{
+	input_file_t *input = data;
+	
+	// Abort thread ?
+	if (terminate_decoder_thread)
+		return MAD_FLOW_STOP;
+
+	return parse_header( input, header );
+}
+
+
 
 /*
  * This is the error callback function. It is called whenever a decoding
@@ -234,12 +274,20 @@ enum mad_flow callback_error(void *data,
 		    struct mad_stream *stream,
 		    struct mad_frame *frame)
 {
+	input_file_t *input = data;
 
 	switch( stream->error ) {
 
-		case MAD_ERROR_LOSTSYNC:
 		case MAD_ERROR_BADCRC:
 		case MAD_ERROR_BADDATAPTR:
+			// Expected while filling the bit reservoir
+			if (input->skip_frames) {
+				input->skip_frames--;
+				return MAD_FLOW_CONTINUE;
+			}
+			// Fall through
+
+		case MAD_ERROR_LOSTSYNC:
 			if (verbose)
 				fprintf(stderr, "Warning: libmad decoding error: 0x%04x (%s)\n",
 					stream->error, mad_stream_errorstr(stream));
@@ -278,6 +326,9 @@ void *thread_decode_mad(void *input)
 
 	if (verbose) printf("Decoder thread started.\n");
 	
+	// Set priority and CPUs
+	rtsched_decoder_thread();
+	
 	// Allocate memory for mad_decoder
 	decoder = malloc(sizeof( struct mad_decoder ));
 	if (!decoder) {
@@ -385,9 +436,9 @@ int parse_id3v1_header( FILE* file ) {
 // Set the first and last byte positions of the audio
 // and set the duration of the audio file
 // (hunts down ID3 tags and ignores them)
-static void mpeg_audio_length( input_file_t *input )
+void mpeg_audio_length( input_file_t *input )
 {
-	FILE* file = input_file->file;
+	FILE* file = input->file;
 
 	/*
 		ID3v1: Look for the marker "TAG" 128 bytes from the end of the file.
@@ -419,10 +470,10 @@ static void mpeg_audio_length( input_file_t *input )
 }
 
 
-// Seek filehandle to the cuepoint
-static void seek_to_cuepoint( input_file_t *input, float cuepoint )
+// Work out which MPEG audio frame a cuepoint is in
+unsigned long cuepoint_to_frame( input_file_t *input, float cuepoint )
 {
-	unsigned long bytes = 0;
+	unsigned long frame = 0;
 
 	if (cuepoint != 0.0) {
 		if (input->bitrate==0) {
@@ -431,37 +482,189 @@ static void seek_to_cuepoint( input_file_t *input, float cuepoint )
 			fprintf(stderr, "Warning: failed to seek to cuepoint, because frame size is unknown.\n");
 		} else if (input->samplerate==0) {
 			fprintf(stderr, "Warning: failed to seek to cuepoint, because sample rate is unknown.\n");
-		} else if (input_file->duration < cuepoint) {
+		} else if (input->duration < cuepoint) {
 			fprintf(stderr, "Warning: failed to seek to cuepoint, because it is beyond end of file.\n" );
 		} else if (cuepoint < 0.0) {
 			fprintf(stderr, "Warning: failed to seek to cuepoint, because it is less than zero.\n" );
 		} else {
-			unsigned long frames = (cuepoint * input->samplerate) / 1152;
-			bytes = frames * input->framesize;
-			input->position = (1152.0f * frames) / input->samplerate;
+			frame = (cuepoint * input->samplerate) / SAMPLES_PER_FRAME;
 		}
-	} else {
-		input->position = 0.0f;
 	}
+	
+	return frame;
+}
 
+
+// Get the time (in seconds) at the start of an MPEG audio frame
+float frame_to_seconds( input_file_t *input, unsigned long frame )
+{
+	if (input->samplerate==0) return 0.0f;
+	return ((float)SAMPLES_PER_FRAME * frame) / input->samplerate;
+}
+
+
+// Seek a filehandle to the start of an MPEG audio frame
+// Returns the number of frames that need decoding and
+// throwing away before the requested frame is reached
+static unsigned int seek_to_frame( input_file_t *input, FILE* file, unsigned long frame )
+{
+	unsigned long start = 0;
+
+	// Start a little early, to fill up the bit reservoir
+	if (frame > PRIME_FRAMES) start = frame - PRIME_FRAMES;
+	
 	// Perform the seek
-	fseek( input->file, input->start_pos+bytes, SEEK_SET);
+	fseek( file, input->start_pos + start * input->framesize, SEEK_SET);
+
+	return frame - start;
 }
 
 
-void start_decoder_thread(void *data, float cuepoint)
+/*
+ * Decode audio from a file straight into a PCM buffer, starting
+ * at an MPEG audio frame, until the buffer is full or the end of the
+ * file is reached. This runs in the calling thread, using its own
+ * decoder state, so it can be used alongside the decoder thread
+ * (as long as 'file' is a different file handle).
+ *
+ * Frames that fail to decode are replaced with silence, so that
+ * the audio in the buffer stays frame aligned with the file.
+ *
+ * Returns the number of samples decoded, or -1 on error.
+ * at_eof is set if the whole of the rest of the file was decoded.
+ */
+
+long decode_to_buffer( input_file_t *input, FILE* file, unsigned long frame_num, pcm_buffer_t *pcm, int *at_eof )
 {
-	input_file_t *input = data;
-	int result;
+	struct mad_stream stream;
+	struct mad_frame frame;
+	struct mad_synth synth;
+	unsigned char* buffer = NULL;
+	size_t buffer_used = 0;
+	unsigned int skip = 0;
+	long result = 0;
+	
+	*at_eof = 0;
+	pcm->length = 0;
+
+	// Allocate a read buffer (with room for the guard bytes)
+	buffer = malloc( READ_BUFFER_SIZE + MAD_BUFFER_GUARD );
+	if (!buffer) {
+		fprintf(stderr, "Error: failed to allocate memory for decode buffer.\n");
+		return -1;
+	}
+
+	// Seek to the frame
+	skip = seek_to_frame( input, file, frame_num );
+
+	mad_stream_init( &stream );
+	mad_frame_init( &frame );
+	mad_synth_init( &synth );
 	
-	// Stop the previous thread
-	finish_decoder_thread();
+	while (pcm->length < pcm->capacity) {
+		unsigned int nsamples, avail, i;
+		mad_fixed_t const *left_ch, *right_ch;
+	
+		// Need more data ?
+		if (stream.buffer == NULL || stream.error == MAD_ERROR_BUFLEN) {
+			size_t bytes;
+		
+			// At end of file ?
+			if (*at_eof) break;
+		
+			// Keep the unused bytes
+			if (stream.next_frame) {
+				buffer_used = buffer + buffer_used - stream.next_frame;
+				memmove( buffer, stream.next_frame, buffer_used );
+			}
+			
+			bytes = fread( buffer + buffer_used, 1, READ_BUFFER_SIZE - buffer_used, file );
+			buffer_used += bytes;
+			
+			// Pad the last frame, so that libmad decodes it
+			if (bytes == 0 || feof( file )) {
+				bzero( buffer + buffer_used, MAD_BUFFER_GUARD );
+				buffer_used += MAD_BUFFER_GUARD;
+				*at_eof = 1;
+			}
+			
+			mad_stream_buffer( &stream, buffer, buffer_used );
+			stream.error = MAD_ERROR_NONE;
+		}
+		
+		// Decode the next frame
+		if (mad_frame_decode( &frame, &stream )) {
+			if (stream.error == MAD_ERROR_BUFLEN) {
+				continue;
+			} else if (stream.error == MAD_ERROR_BADDATAPTR ||
+			           stream.error == MAD_ERROR_BADCRC) {
+				// Header was fine, but the audio wasn't
+				mad_frame_mute( &frame );
+			} else if (MAD_RECOVERABLE(stream.error)) {
+				continue;
+			} else {
+				fprintf(stderr, "Warning: libmad decoding error: 0x%04x (%s)\n",
+					stream.error, mad_stream_errorstr(&stream));
+				result = -1;
+				break;
+			}
+		}
+		
+		// Check the sample rate etc.
+		if (parse_header( input, &frame.header ) != MAD_FLOW_CONTINUE) {
+			result = -1;
+			break;
+		}
+		
+		// Frame was only decoded to fill the bit reservoir ?
+		if (skip) {
+			skip--;
+			continue;
+		}
+		
+		// Convert to PCM
+		mad_synth_frame( &synth, &frame );
+		nsamples = synth.pcm.length;
+		left_ch = synth.pcm.samples[0];
+		right_ch = synth.pcm.samples[1];
+		
+		// Buffer full ?
+		avail = pcm->capacity - pcm->length;
+		if (nsamples > avail) {
+			nsamples = avail;
+			*at_eof = 0;
+		}
+		
+		for (i=0; i<nsamples; i++) {
+			float sample = mad_f_todouble(*left_ch++);
+			pcm->samples[0][pcm->length] = sample;
+			if (synth.pcm.channels == 2) sample = mad_f_todouble(*right_ch++);
+			pcm->samples[1][pcm->length] = sample;
+			pcm->length++;
+		}
+	}
+	
+	// Ran out of room before end of file ?
+	if (pcm->length >= pcm->capacity && stream.next_frame &&
+	    stream.bufend - stream.next_frame > MAD_BUFFER_GUARD) {
+		*at_eof = 0;
+	}
+	
+	mad_synth_finish( &synth );
+	mad_frame_finish( &frame );
+	mad_stream_finish( &stream );
+	free( buffer );
 
+	if (result < 0) return result;
+	return pcm->length;
+}
 
 
-	// Don't allow another control thread to 
-	// start or stop the decoder thread
-	pthread_mutex_lock( &decoder_thread_control );
+// Start the decoder thread running (decoder control must be locked)
+static
+void launch_decoder_thread( input_file_t *input )
+{
+	int result;
 	
 	// Sanity check
 	if (decoder_thread_exists) {
@@ -469,9 +672,6 @@ void start_decoder_thread(void *data, float cuepoint)
 		exit(-1);
 	}
 
-	// Go to Loading state
-	set_state( MADJACK_STATE_LOADING );
-	
 	// Signal the thread to run
 	terminate_decoder_thread = 0;
 
@@ -479,15 +679,13 @@ void start_decoder_thread(void *data, float cuepoint)
 	input->buffer_used = 0;
 	
 	// Empty out ringbuffers
-	jack_ringbuffer_reset( ringbuffer[0] );
-	jack_ringbuffer_reset( ringbuffer[1] );
-	
-	// Get the length/start of the audio in the file (after ID3 tags)
-	mpeg_audio_length( input );
-	
-	// Seek filehandle to the cuepoint
-	seek_to_cuepoint( input, cuepoint );
+	reset_rbsize();
 	
+	// Start reading ahead of the decoder
+	// (not needed if the whole file is already in memory)
+	if (readahead_duration > 0.0f && input->preload_buffer == NULL) {
+		start_readahead_thread( input );
+	}
 		
 	// Start the decoder thread
 	result = pthread_create(&decoder_thread, NULL, thread_decode_mad, input);
@@ -498,6 +696,55 @@ void start_decoder_thread(void *data, float cuepoint)
 		// A thread has been created that will later need disposed of
 		decoder_thread_exists = 1;
 	}
+}
+
+
+void start_decoder_thread(void *data, float cuepoint)
+{
+	input_file_t *input = data;
+	unsigned long frame;
+	
+	// Stop the previous thread
+	finish_decoder_thread();
+
+
+
+	// Don't allow another control thread to 
+	// start or stop the decoder thread
+	pthread_mutex_lock( &decoder_thread_control );
+	
+	// Go to Loading state
+	set_state( MADJACK_STATE_LOADING );
+	
+	// Get the length/start of the audio in the file (after ID3 tags)
+	mpeg_audio_length( input );
+	
+	// Seek filehandle to the cuepoint
+	frame = cuepoint_to_frame( input, cuepoint );
+	input->position = frame_to_seconds( input, frame );
+	input->skip_frames = seek_to_frame( input, input->file, frame );
+	
+	launch_decoder_thread( input );
+
+	pthread_mutex_unlock( &decoder_thread_control );
+}
+
+
+/*
+ * Start decoding again from a different MPEG audio frame,
+ * without changing state. Used to carry on decoding into the
+ * ringbuffer behind audio that is being played from memory.
+ */
+
+void restart_decoder_thread( input_file_t *input, unsigned long frame )
+{
+	// Stop the previous thread
+	finish_decoder_thread();
+
+	pthread_mutex_lock( &decoder_thread_control );
+
+	input->skip_frames = seek_to_frame( input, input->file, frame );
+	launch_decoder_thread( input );
 
 	pthread_mutex_unlock( &decoder_thread_control );
 }
@@ -514,6 +761,9 @@ void finish_decoder_thread()
 	
 		// Signal the thread to terminate
 		terminate_decoder_thread = 1;
+		
+		// Stop the I/O thread (so that the decoder isn't waiting on it)
+		finish_readahead_thread();
 
 		if (verbose && is_decoding)
 			printf("Waiting for decoder thread to finish.\n");
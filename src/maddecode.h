@@ -22,6 +22,9 @@
 
 
 
+#include <stdio.h>
+#include "madjack.h"
+
 #ifndef _MADDECODE_H_
 #define _MADDECODE_H_
 
@@ -30,6 +33,8 @@
 #define ID3v2_HEADER_LEN	(10)
 #define ID3v2_FOOTER_LEN	(10)
 #define ID3v1_HEADER_LEN	(3)
+#define SAMPLES_PER_FRAME	(1152)
+#define PRIME_FRAMES		(1)		// Frames decoded before seek point to fill bit reservoir
 
 
 // Gobals
@@ -39,6 +44,11 @@ extern int is_decoding;
 // Prototypes
 void start_decoder_thread(void *input, float cuepoint);
 void finish_decoder_thread();
+void restart_decoder_thread( input_file_t *input, unsigned long frame );
+void mpeg_audio_length( input_file_t *input );
+unsigned long cuepoint_to_frame( input_file_t *input, float cuepoint );
+float frame_to_seconds( input_file_t *input, unsigned long frame );
+long decode_to_buffer( input_file_t *input, FILE* file, unsigned long frame, pcm_buffer_t *pcm, int *at_eof );
 
 #endif
 
@@ -17,12 +17,24 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/time.h>
 
 #include <lo/lo.h>
+#include "statusreader.h"
 #include "config.h"
 
 
 #define REPLY_TIMEOUT	(1000)		// Number of milliseconds to wait for a reply
+#define JITTER_SETTLE	(1000)		// Milliseconds to let the deck cue before each start
+#define BENCH_COUNT		(1000)		// Default number of pings for the bench command
+
+
+static int benchmarking = 0;		// Count pongs instead of displaying them
+static int pongs = 0;				// Number of pongs received
+static int last_pong = -1;			// Sequence number of the last pong
+static char *pong_seen = NULL;		// Which of the flood's pings have been answered
+static int pong_first = 0;			// Sequence number of the first ping in the flood
+static int pong_count = 0;			// Number of pings in the flood
 
 
 // Display how to use this program
@@ -31,19 +43,46 @@ void usage( )
 {
 	printf("madjack-remote version %s\n\n", PACKAGE_VERSION);
 	printf("Usage: madjack-remote [options] <command>\n");
+	printf("       madjack-remote -m <addr:port>\n");
+	printf("       madjack-remote -s <name>\n");
 	printf("   -u <url>    URL for remote MadJACK server\n");
-	printf("   -p <port>   Port for remote MadJACK server\n\n");
+	printf("   -p <port>   Port for remote MadJACK server\n");
+	printf("   -m <addr:port> Display updates sent to a multicast group (madjack -M)\n");
+	printf("   -s <name>   Display status of the local deck with this JACK client name,\n");
+	printf("               read from shared memory\n\n");
 	printf("Supported Commands:\n");
 	printf("  play              Start deck playing\n");
 	printf("  pause             Pause deck\n");
 	printf("  stop              Stop Deck playback\n");
 	printf("  cue [<cuepoint>]  Cue deck (option cuepoint in seconds)\n");
+	printf("  seek <position>   Jump to position (in seconds) without stopping\n");
+	printf("  loop <start> <end> [<fade>] Loop a region of the track (in seconds)\n");
+	printf("  unloop            Carry on playing past the end of the loop\n");
+	printf("  sethotcue <n> <cuepoint> Set hot cue <n> (cuepoint in seconds)\n");
+	printf("  hotcue <n>        Start playing from hot cue <n>\n");
+	printf("  arm <group>       Arm deck to start with the rest of <group>\n");
+	printf("  disarm            Take deck out of the group it is armed in\n");
+	printf("  groupplay <group> Start all the decks armed in <group> together\n");
+	printf("  group <group>     Get how many decks are armed and how far apart they started\n");
 	printf("  eject             Eject the current track from deck\n");
 	printf("  load <filepath>   Load <filepath> into deck\n");
+	printf("  preload <filepath> Load whole of <filepath> into memory\n");
+	printf("  add <filepath>    Add <filepath> to the end of the queue\n");
+	printf("  insert <n> <filepath> Insert <filepath> at position <n> in the queue\n");
+	printf("  remove <n>        Take track <n> out of the queue\n");
+	printf("  clear             Empty the queue\n");
+	printf("  queue             List the tracks waiting in the queue\n");
+	printf("  crossfade [<secs>] Get or set the crossfade between queued tracks (0 for gapless)\n");
 	printf("  state             Get deck state\n");
 	printf("  position          Get playback position (in seconds)\n");
+	printf("  status            Get state, position, track and error all at once\n");
 	printf("  filepath          Get path of the currently loaded file\n");
+	printf("  memory            Get memory used by the deck (in bytes)\n");
+	printf("  schedule          Get how late timetagged starts have been\n");
+	printf("  jitter [<count>] [<lead>] Cue and start the deck <count> times, with\n");
+	printf("                    starts timetagged <lead> ms ahead, then show the error\n");
 	printf("  ping              Check deck is still there\n");
+	printf("  bench [<count>]   Measure round trip time and loss of pings\n");
 	exit(1);
 }
 
@@ -70,6 +109,27 @@ int position_handler(const char *path, const char *types, lo_arg **argv, int arg
     return 0;
 }
 
+static
+int status_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	printf("State: %s\n", &argv[0]->s);
+	printf("Position: %2.2f (%d samples)\n", argv[1]->f, argv[2]->i);
+	printf("Duration: %2.2f\n", argv[3]->f);
+	printf("Filepath: %s\n", &argv[4]->s);
+	printf("Buffered: %2.0f ms\n", argv[5]->f);
+	printf("Error: %s\n", &argv[6]->s);
+    return 0;
+}
+
+static
+int duration_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	printf("Duration: %2.2f\n", argv[0]->f);
+    return 0;
+}
+
 static
 int filepath_handler(const char *path, const char *types, lo_arg **argv, int argc,
 		 lo_message msg, void *user_data)
@@ -79,20 +139,273 @@ int filepath_handler(const char *path, const char *types, lo_arg **argv, int arg
 }
 
 
+static
+int memory_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	printf("Preloaded: %lld bytes\n", (long long)argv[0]->h);
+	printf("Total: %lld bytes\n", (long long)argv[1]->h);
+    return 0;
+}
+
+static
+int queue_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	int i;
+	
+	if (argc==0) printf("Queue is empty.\n");
+	for (i=0; i<argc; i++) {
+		if (types[i] == LO_STRING) printf("%d: %s\n", i, &argv[i]->s);
+	}
+    return 0;
+}
+
+static
+int crossfade_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	printf("Crossfade: %2.2f seconds\n", argv[0]->f);
+    return 0;
+}
+
+static
+int schedule_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	printf("Scheduled starts: %lld (%lld late)\n", (long long)argv[0]->h, (long long)argv[1]->h);
+	printf("Measured: %lld\n", (long long)argv[2]->h);
+	printf("Error (frames): median %d, 99th percentile %d, max %d\n",
+	       argv[3]->i, argv[4]->i, argv[5]->i);
+	printf("Least time in hand: %2.1f ms\n", argv[6]->f);
+    return 0;
+}
+
+static
+int group_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	printf("Group: %s\n", &argv[0]->s);
+	printf("Armed: %d decks\n", argv[1]->i);
+	printf("Started: %d decks, %d frames apart\n", argv[2]->i, argv[3]->i);
+    return 0;
+}
+
 static
 int ping_handler(const char *path, const char *types, lo_arg **argv, int argc,
 		 lo_message msg, void *user_data)
 {
-	printf("Pong.\n");
+	if (!benchmarking) printf("Pong.\n");
+	
+	if (argc) {
+		int seq = argv[0]->i;
+		
+		last_pong = seq;
+		
+		// Only count one reply to each ping of the flood
+		if (pong_seen) {
+			if (seq < pong_first || seq >= pong_first + pong_count) return 0;
+			if (pong_seen[seq - pong_first]) return 0;
+			pong_seen[seq - pong_first] = 1;
+		}
+	}
+	pongs++;
     return 0;
 }
 
+static
+int osc_stats_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	int total = argv[0]->i + argv[1]->i;
+	
+	printf("Replies: %d sent directly, %d through liblo (%2.1f%% allocating)\n",
+	       argv[0]->i, argv[1]->i, total ? 100.0f * argv[1]->i / total : 0.0f);
+    return 0;
+}
+
+
+// Send a message in a bundle, timetagged some milliseconds from now
+static
+int send_timetagged( lo_address addr, lo_server serv, const char* path, float ms )
+{
+	lo_bundle bundle;
+	lo_timetag tt;
+	double frac;
+	int result;
+	
+	lo_timetag_now( &tt );
+	frac = tt.frac / 4294967296.0 + ms / 1000.0;
+	tt.sec += (uint32_t)frac;
+	tt.frac = (uint32_t)((frac - (uint32_t)frac) * 4294967296.0);
+	
+	bundle = lo_bundle_new( tt );
+	lo_bundle_add_message( bundle, path, lo_message_new() );
+	result = lo_send_bundle_from( addr, serv, bundle );
+	lo_bundle_free_messages( bundle );
+	
+	return result;
+}
+
+
+// Start the deck a number of times with timetagged bundles
+static
+int measure_jitter( lo_address addr, lo_server serv, int count, float lead )
+{
+	int i;
+	
+	for (i=0; i<count; i++) {
+		lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/cue", "");
+		usleep( JITTER_SETTLE * 1000 );
+		
+		if (send_timetagged( addr, serv, "/deck/play", lead ) < 1) return -1;
+		usleep( (lead + 100) * 1000 );
+		
+		lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/stop", "");
+	}
+	
+	return lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/get_schedule", "");
+}
+
+
+// Display the updates that decks send to a multicast group, until killed
+static
+int listen_multicast( char *group )
+{
+	char *colon = strrchr( group, ':' );
+	lo_server serv = NULL;
+	
+	if (!colon) usage( );
+	*colon = '\0';
+	
+	serv = lo_server_new_multicast( group, colon+1, error_handler );
+	if (!serv) {
+		fprintf(stderr, "Error: failed to join multicast group %s:%s.\n", group, colon+1);
+		return -2;
+	}
+	lo_server_add_method( serv, "/deck/state", "s", state_handler, NULL);
+	lo_server_add_method( serv, "/deck/duration", "f", duration_handler, NULL);
+	lo_server_add_method( serv, "/deck/position", "f", position_handler, NULL);
+	lo_server_add_method( serv, "/deck/filepath", "s", filepath_handler, NULL);
+	
+	while (lo_server_recv( serv ) >= 0) {
+		fflush( stdout );
+	}
+	
+	lo_server_free( serv );
+	return 0;
+}
+
+
+// Display the status of a deck on this host, from shared memory
+static
+int read_shm_status( const char *name )
+{
+	status_page_t *page = status_reader_open( name );
+	deck_status_t status;
+	
+	if (!page) {
+		fprintf(stderr, "Error: no status page for deck '%s'.\n", name);
+		return -1;
+	}
+	
+	if (status_read( page, &status )) {
+		fprintf(stderr, "Error: status page for deck '%s' is not being updated.\n", name);
+		status_reader_close( page );
+		return -2;
+	}
+	
+	printf("State: %s\n", status.state_name);
+	printf("Position: %2.2f (%u samples)\n", status.position, status.position_samples);
+	printf("Duration: %2.2f\n", status.duration);
+	printf("Filepath: %s\n", status.filepath);
+	printf("Buffered: %2.0f ms\n", status.buffered * 1000.0f);
+	printf("Levels: %1.3f %1.3f\n", status.level[0], status.level[1]);
+	printf("Error: %s\n", status.error);
+	
+	status_reader_close( page );
+	return 0;
+}
+
+
+static
+unsigned long long now_usecs()
+{
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+static
+int compare_usecs( const void *a, const void *b )
+{
+	unsigned long long ua = *(const unsigned long long*)a;
+	unsigned long long ub = *(const unsigned long long*)b;
+	return (ua > ub) - (ua < ub);
+}
+
+
+// Time pings one at a time, then send a flood of them and count the replies
+static
+int benchmark( lo_address addr, lo_server serv, int count )
+{
+	unsigned long long *rtt = calloc( count, sizeof(unsigned long long) );
+	unsigned long long start, elapsed;
+	int received = 0, i;
+	
+	if (!rtt || count < 1) return -1;
+	benchmarking = 1;
+	
+	// Round trip time (ignoring late replies to earlier pings)
+	for (i=0; i<count; i++) {
+		unsigned long long sent = now_usecs();
+		
+		last_pong = -1;
+		if (lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/ping", "i", i) < 1) break;
+		while (last_pong != i && lo_server_recv_noblock(serv, REPLY_TIMEOUT) > 0) {}
+		if (last_pong == i) rtt[received++] = now_usecs() - sent;
+	}
+	
+	if (received) {
+		qsort( rtt, received, sizeof(unsigned long long), compare_usecs );
+		printf("Round trip: median %llu us, 99th percentile %llu us, max %llu us\n",
+		       rtt[received / 2], rtt[(received * 99) / 100], rtt[received - 1]);
+	}
+	printf("Round trip: %d sent, %d lost\n", i, i - received);
+	free( rtt );
+	
+	// Flood (numbered on from the round trip pings)
+	pong_seen = calloc( count, sizeof(char) );
+	if (!pong_seen) return -1;
+	pong_first = count;
+	pong_count = count;
+	pongs = 0;
+	start = now_usecs();
+	for (i=0; i<count; i++) {
+		if (lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/ping", "i", pong_first + i) < 1) break;
+	}
+	while (pongs < i && lo_server_recv_noblock(serv, REPLY_TIMEOUT) > 0) {}
+	elapsed = now_usecs() - start;
+	free( pong_seen );
+	pong_seen = NULL;
+	
+	printf("Flood: %d sent, %d replies (%2.1f%% lost) in %2.1f ms, %d queries/s\n",
+	       i, pongs, i ? 100.0f * (i - pongs) / i : 0.0f, elapsed / 1000.0f,
+	       elapsed ? (int)((pongs * 1000000ULL) / elapsed) : 0);
+	
+	// How many replies needed an allocation
+	return lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/get_osc_stats", "");
+}
+
 
 
 int main(int argc, char *argv[])
 {
 	char *port = NULL;
 	char *url = NULL;
+	char *multicast = NULL;
+	char *shm_name = NULL;
 	lo_address addr = NULL;
 	lo_server serv = NULL;
 	int need_reply = 0;
@@ -100,7 +413,7 @@ int main(int argc, char *argv[])
 	int opt;
 
 	// Parse Switches
-	while ((opt = getopt(argc, argv, "p:u:h")) != -1) {
+	while ((opt = getopt(argc, argv, "p:u:m:s:h")) != -1) {
 		switch (opt) {
 			case 'p':
 				port = optarg;
@@ -110,12 +423,24 @@ int main(int argc, char *argv[])
 				url = optarg;
 				break;
 				
+			case 'm':
+				multicast = optarg;
+				break;
+				
+			case 's':
+				shm_name = optarg;
+				break;
+				
 			default:
 				usage( );
 				break;
 		}
 	}
 	
+	// Just listening ?
+	if (multicast) return listen_multicast( multicast );
+	if (shm_name) return read_shm_status( shm_name );
+	
 	// Need either a port or URL
 	if (!port && !url) {
 		fprintf(stderr, "Either URL or Port argument is required.\n");
@@ -134,11 +459,19 @@ int main(int argc, char *argv[])
 
 
 	// Create a server for receiving replies on
-    serv = lo_server_new(NULL, error_handler);
+    serv = lo_server_new_with_proto(NULL, lo_address_get_protocol(addr), error_handler);
 	lo_server_add_method( serv, "/deck/state", "s", state_handler, addr);
 	lo_server_add_method( serv, "/deck/position", "f", position_handler, addr);
 	lo_server_add_method( serv, "/deck/filepath", "s", filepath_handler, addr);
+	lo_server_add_method( serv, "/deck/status", "sfifsfs", status_handler, addr);
+	lo_server_add_method( serv, "/deck/memory", "hh", memory_handler, addr);
+	lo_server_add_method( serv, "/deck/schedule", "hhhiiif", schedule_handler, addr);
+	lo_server_add_method( serv, "/group/state", "siii", group_handler, addr);
+	lo_server_add_method( serv, "/queue/items", NULL, queue_handler, addr);
+	lo_server_add_method( serv, "/queue/crossfade", "f", crossfade_handler, addr);
 	lo_server_add_method( serv, "/pong", "", ping_handler, addr);
+	lo_server_add_method( serv, "/pong", "i", ping_handler, addr);
+	lo_server_add_method( serv, "/osc_stats", "ii", osc_stats_handler, addr);
 
 
 	// Check to see what message to send
@@ -156,21 +489,107 @@ int main(int argc, char *argv[])
 		} else {
 			result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/cue", "");
 		}
+	} else if (strcmp( argv[0], "seek") == 0) {
+		// Check for argument
+		if (argc!=2) usage( );
+		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/seek", "f", (float)atof(argv[1]));
+	} else if (strcmp( argv[0], "loop") == 0) {
+		// Check for arguments
+		if (argc==3) {
+			result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/loop", "ff",
+			                      (float)atof(argv[1]), (float)atof(argv[2]));
+		} else if (argc==4) {
+			result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/loop", "fff",
+			                      (float)atof(argv[1]), (float)atof(argv[2]), (float)atof(argv[3]));
+		} else {
+			usage( );
+		}
+	} else if (strcmp( argv[0], "unloop") == 0) {
+		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/loop/exit", "");
+	} else if (strcmp( argv[0], "sethotcue") == 0) {
+		// Check for arguments
+		if (argc!=3) usage( );
+		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/hotcue/set", "if",
+		                      atoi(argv[1]), (float)atof(argv[2]));
+	} else if (strcmp( argv[0], "hotcue") == 0) {
+		// Check for argument
+		if (argc!=2) usage( );
+		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/hotcue/fire", "i", atoi(argv[1]));
+	} else if (strcmp( argv[0], "arm") == 0) {
+		// Check for argument
+		if (argc!=2) usage( );
+		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/group/arm", "s", argv[1]);
+	} else if (strcmp( argv[0], "disarm") == 0) {
+		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/group/disarm", "");
+	} else if (strcmp( argv[0], "groupplay") == 0) {
+		// Check for argument
+		if (argc!=2) usage( );
+		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/group/play", "s", argv[1]);
+	} else if (strcmp( argv[0], "group") == 0) {
+		// Check for argument
+		if (argc!=2) usage( );
+		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/group/get_state", "s", argv[1]);
+		need_reply=1;
 	} else if (strcmp( argv[0], "eject") == 0) {
 		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/eject", "");
 	} else if (strcmp( argv[0], "load") == 0) {
 		// Check for argument
 		if (argc!=2) usage( );
 		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/load", "s", argv[1]);
+	} else if (strcmp( argv[0], "preload") == 0) {
+		// Check for argument
+		if (argc!=2) usage( );
+		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/preload", "s", argv[1]);
+	} else if (strcmp( argv[0], "add") == 0) {
+		// Check for argument
+		if (argc!=2) usage( );
+		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/queue/add", "s", argv[1]);
+	} else if (strcmp( argv[0], "insert") == 0) {
+		// Check for arguments
+		if (argc!=3) usage( );
+		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/queue/insert", "is", atoi(argv[1]), argv[2]);
+	} else if (strcmp( argv[0], "remove") == 0) {
+		// Check for argument
+		if (argc!=2) usage( );
+		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/queue/remove", "i", atoi(argv[1]));
+	} else if (strcmp( argv[0], "clear") == 0) {
+		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/queue/clear", "");
+	} else if (strcmp( argv[0], "queue") == 0) {
+		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/queue/get", "");
+		need_reply=1;
+	} else if (strcmp( argv[0], "crossfade") == 0) {
+		if (argc==2) {
+			result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/queue/crossfade", "f", atof(argv[1]));
+		} else {
+			result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/queue/get_crossfade", "");
+			need_reply=1;
+		}
 	} else if (strcmp( argv[0], "state") == 0) {
 		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/get_state", "");
 		need_reply=1;
 	} else if (strcmp( argv[0], "position") == 0) {
 		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/get_position", "");
 		need_reply=1;
+	} else if (strcmp( argv[0], "status") == 0) {
+		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/get_status", "");
+		need_reply=1;
 	} else if (strcmp( argv[0], "filepath") == 0) {
 		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/get_filepath", "");
 		need_reply=1;
+	} else if (strcmp( argv[0], "memory") == 0) {
+		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/get_memory", "");
+		need_reply=1;
+	} else if (strcmp( argv[0], "schedule") == 0) {
+		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/deck/get_schedule", "");
+		need_reply=1;
+	} else if (strcmp( argv[0], "jitter") == 0) {
+		int count = (argc>=2) ? atoi(argv[1]) : 10;
+		float lead = (argc>=3) ? atof(argv[2]) : 100.0f;
+		result = measure_jitter( addr, serv, count, lead );
+		need_reply=1;
+	} else if (strcmp( argv[0], "bench") == 0) {
+		result = benchmark( addr, serv, (argc>=2) ? atoi(argv[1]) : BENCH_COUNT );
+		need_reply=1;
 	} else if (strcmp( argv[0], "ping") == 0) {
 		result = lo_send_from(addr, serv, LO_TT_IMMEDIATE, "/ping", "");
 		need_reply=1;
@@ -40,6 +40,26 @@
 #include "mjosc.h"
 #include "madjack.h"
 #include "maddecode.h"
+#include "preload.h"
+#include "readahead.h"
+#include "cart.h"
+#include "pcmcache.h"
+#include "overlay.h"
+#include "hotcue.h"
+#include "seek.h"
+#include "loop.h"
+#include "rbsize.h"
+#include "rtmem.h"
+#include "rtsched.h"
+#include "render.h"
+#include "transport.h"
+#include "jackstats.h"
+#include "schedule.h"
+#include "group.h"
+#include "status.h"
+#include "subscribe.h"
+#include "playlist.h"
+#include "command.h"
 #include "config.h"
 
 
@@ -52,6 +72,12 @@ jack_client_t *client = NULL;
 input_file_t *input_file = NULL;	// Input file info structure
 int state = MADJACK_STATE_STARTING;	// State of MadJACK
 int play_when_ready = 0;			// When in READY state, start playing immediately
+int preload = 0;					// Read whole of each file into memory when loading
+int warm_stop = 0;					// Keep the decoder and buffers when stopping
+int warm_stopped = 0;				// Set while stopped with the decoder parked
+int freewheeling = 0;				// Set while JACK is running faster than real time
+static unsigned long freewheel_frames = 0;	// Frames played while freewheeling
+static unsigned long long freewheel_start = 0;	// Time freewheeling started
 char * root_directory = NULL;		// Root directory (files loaded relative to this)
 int verbose = 0;					// Verbose flag (display more information)
 int quiet = 0;						// Quiet flag (stay silent unless error)
@@ -63,27 +89,91 @@ char error_string[MAX_ERRORSTR_LEN] = "\0";	// Last error that occurred
 
 
 
+// While freewheeling, the callback isn't real-time, so it can
+// wait for the decoder to catch up instead of running dry
+static
+void wait_for_decoder( unsigned int channel, size_t bytes )
+{
+	while (freewheeling && is_decoding &&
+	       jack_ringbuffer_read_space( ringbuffer[channel] ) < bytes) {
+		usleep( 100 );
+	}
+}
+
+
 // Callback called by JACK when audio is available
 static
 int callback_jack(jack_nframes_t nframes, void *arg)
 {
-    size_t to_read = sizeof (jack_default_audio_sample_t) * nframes;
-	unsigned int c;
+	jack_nframes_t start_at = 0, stop_at = nframes, frames;
+    size_t to_read;
+	unsigned int from_loop = 0, from_overlay = 0, from_next = 0;
+	pcm_buffer_t *next = NULL;
+	float *output[2];
+	float peak[2] = {0.0f, 0.0f};
+	unsigned int c, i;
+	
+	// Keep up with the JACK transport
+	if (transport_follow) transport_process( nframes );
+	
+	// Start or stop part way through the period ?
+	group_process();
+	schedule_process( nframes, &start_at, &stop_at );
+	frames = stop_at - start_at;
+	to_read = sizeof (jack_default_audio_sample_t) * frames;
+	
+	// Will the track run out, with the next one from the playlist ready ?
+	next = playlist_splice( frames );
 	
 	for (c=0; c < 2; c++)
 	{	
-		char *buf = (char*)jack_port_get_buffer(outport[c], nframes);
+		char *out = (char*)jack_port_get_buffer(outport[c], nframes);
+		char *buf = out + start_at * sizeof(float);
 		size_t len = 0;
+		
+		output[c] = (float*)out;
 
 		// What state are we in ?
 		if (get_state() == MADJACK_STATE_PLAYING) {
+			unsigned int got;
+		
+			// A loop plays until it is exited
+			if (loop_is_active()) {
+				got = read_loop( c, (float*)buf, frames );
+				if (c==0) from_loop = got;
+				len += got * sizeof(float);
+			}
 		
-			// Copy data from ring buffer to output buffer
-			len += jack_ringbuffer_read(ringbuffer[c], buf, to_read);
+			if (len < to_read && cart_is_loaded()) {
+				// Copy data straight from the decoded cart
+				len += read_cart( c, (float*)(buf+len), frames-from_loop ) * sizeof(float);
+			} else if (len < to_read) {
+				// Audio already in memory comes first
+				if (overlay_is_active()) {
+					got = read_overlay( c, (float*)(buf+len), frames-from_loop );
+					if (c==0) from_overlay = got;
+					len += got * sizeof(float);
+				}
+				
+				// Copy data from ring buffer to output buffer
+				if (len < to_read) {
+					if (freewheeling) wait_for_decoder( c, to_read-len );
+					len += jack_ringbuffer_read(ringbuffer[c], buf+len, to_read-len);
+				}
+				
+				// Then carry straight on with the next track
+				if (next && len < to_read) {
+					got = (to_read - len) / sizeof(float);
+					if (got > next->length) got = next->length;
+					memcpy( buf+len, next->samples[c], got * sizeof(float) );
+					if (c==0) from_next = got;
+					len += got * sizeof(float);
+				}
+			}
 			
 			// Not enough samples ?
 			if (len < to_read) {
-				if (is_decoding) {
+				if (is_decoding && !cart_is_loaded()) {
 					// If still decoding then something has gone wrong
 					error_handler( "Audio Ringbuffer underrun" );
 				} else {
@@ -93,11 +183,6 @@ int callback_jack(jack_nframes_t nframes, void *arg)
 					input_file->position = input_file->duration;
 				}
 			}
-			
-			// Increment the position in the track
-			if (c==0 && get_state() == MADJACK_STATE_PLAYING) {
-					input_file->position += ((float)nframes / jack_get_sample_rate( client ));
-			}
 		}
 		
 		// If we don't have enough audio, fill it up with silence
@@ -105,7 +190,48 @@ int callback_jack(jack_nframes_t nframes, void *arg)
 		if (to_read > len)
 			bzero( buf+len, to_read - len );
 		
+		// Silence before a scheduled start, and after a scheduled stop
+		if (start_at) bzero( out, start_at * sizeof(float) );
+		if (stop_at < nframes) bzero( out + stop_at * sizeof(float), (nframes - stop_at) * sizeof(float) );
+		
+		// Peak level, for the status page
+		for (i=0; i<nframes; i++) {
+			float level = fabsf( ((float*)out)[i] );
+			if (level > peak[c]) peak[c] = level;
+		}
+	}
+	
+	// When did a timetagged start become audible ?
+	schedule_measure( output, start_at, nframes );
+	
+	// The rest of the next track plays from memory
+	if (next) playlist_spliced( next, from_next );
+	
+	// Move on the loop/cart/overlay, now that both channels have been read
+	if (get_state() == MADJACK_STATE_PLAYING) {
+		if (from_loop) advance_loop( from_loop );
+		if (cart_is_loaded()) advance_cart( frames - from_loop );
+		else if (from_overlay) advance_overlay( from_overlay );
+		
+		if (freewheeling) freewheel_frames += nframes;
+		
+		// Increment the position in the track
+		if (from_loop) {
+			input_file->position = get_loop_position() +
+				((float)(frames - from_loop) / jack_get_sample_rate( client ));
+		} else if (next) {
+			input_file->position = ((float)from_next / jack_get_sample_rate( client ));
+		} else {
+			input_file->position += ((float)frames / jack_get_sample_rate( client ));
+		}
+		
+		// Reached a scheduled stop
+		if (stop_at < nframes) set_state( MADJACK_STATE_PAUSED );
 	}
+	
+	// Publish the new position
+	status_set_levels( peak[0], peak[1] );
+	status_update( 0 );
 
 
 	// Success
@@ -124,6 +250,26 @@ void shutdown_callback_jack(void *arg)
 }
 
 
+// Called by JACK when it starts or stops freewheeling
+static
+void freewheel_callback_jack(int starting, void *arg)
+{
+	if (starting) {
+		freewheel_frames = 0;
+		freewheel_start = get_usecs();
+		freewheeling = 1;
+		if (verbose) printf("JACK has started freewheeling.\n");
+	} else {
+		float seconds = (float)freewheel_frames / jack_get_sample_rate( client );
+		float elapsed = (get_usecs() - freewheel_start) / 1000000.0f;
+		
+		freewheeling = 0;
+		if (!quiet) printf("Freewheeling played %2.2f seconds of audio in %2.2f seconds (%2.1fx real time).\n",
+		                   seconds, elapsed, elapsed > 0.0f ? seconds / elapsed : 0.0f);
+	}
+}
+
+
 void connect_jack_port( jack_port_t *port, const char* in )
 {
 	const char* out = jack_port_name( port );
@@ -179,6 +325,9 @@ void init_jack( const char* client_name, jack_options_t jack_opt )
 		exit(1);
 	}
 	if (!quiet) printf("JACK client registered as '%s'.\n", jack_get_client_name( client ) );
+	
+	// Publish our status under the same name
+	init_status( jack_get_client_name( client ) );
 
 
 	// Create our output ports
@@ -196,8 +345,9 @@ void init_jack( const char* client_name, jack_options_t jack_opt )
 	// Create ring buffers
 	ringbuffer_size = jack_get_sample_rate( client ) * rb_duration * sizeof(float);
 	if (verbose) printf("Size of the ring buffers is %2.2f seconds (%d bytes).\n", rb_duration, (int)ringbuffer_size );
+	init_rtmem( rtmem_ringbuffer_bytes( ringbuffer_size ) * 2 + READ_BUFFER_SIZE + RTMEM_ALIGN );
 	for(i=0; i<2; i++) {
-		if (!(ringbuffer[i] = jack_ringbuffer_create( ringbuffer_size ))) {
+		if (!(ringbuffer[i] = rtmem_ringbuffer_create( ringbuffer_size ))) {
 			fprintf(stderr, "Cannot create ringbuffer.\n");
 			exit(1);
 		}
@@ -208,6 +358,10 @@ void init_jack( const char* client_name, jack_options_t jack_opt )
 
 	// Register callback
 	jack_set_process_callback(client, callback_jack, NULL);
+	jack_set_freewheel_callback(client, freewheel_callback_jack, NULL);
+	
+	// Register latency, period size and xrun callbacks
+	init_jackstats();
 	
 }
 
@@ -219,8 +373,8 @@ void finish_jack()
 	jack_client_close(client);
 	
 	// Free up the ring buffers
-	jack_ringbuffer_free( ringbuffer[0] );
-	jack_ringbuffer_free( ringbuffer[1] );
+	rtmem_ringbuffer_free( ringbuffer[0] );
+	rtmem_ringbuffer_free( ringbuffer[1] );
 }
 
 
@@ -241,7 +395,8 @@ input_file_t* init_inputfile()
 	
 	// Allocate memory for read buffer
 	ptr->buffer_size = READ_BUFFER_SIZE;
-	ptr->buffer = malloc( ptr->buffer_size );
+	ptr->buffer = rtmem_alloc( ptr->buffer_size );
+	if (ptr->buffer == NULL) ptr->buffer = malloc( ptr->buffer_size );
 	if (ptr->buffer == NULL) {
 		fprintf(stderr, "Failed to allocate memory for read buffer.\n");
 		exit(1);
@@ -262,9 +417,13 @@ void finish_inputfile(input_file_t* ptr)
 	
 	// Free filepath
 	if (ptr->filepath) free( ptr->filepath );
+	if (ptr->fullpath) free( ptr->fullpath );
+
+	// Free preloaded file
+	free_preload( ptr );
 
 	// Free up memory used by buffer
-	if (ptr->buffer) free( ptr->buffer );
+	if (ptr->buffer && !rtmem_owns( ptr->buffer )) free( ptr->buffer );
 	
 	// Free up main data structure memory
 	free( ptr );
@@ -304,6 +463,7 @@ void error_handler( char *fmt, ... )
 	// Store the error message
 	vsnprintf( error_string, MAX_ERRORSTR_LEN, fmt, args );
 	va_end( args );
+	status_update( 1 );
 
 }
 
@@ -325,6 +485,26 @@ const char* get_state_name( enum madjack_state state )
 	}
 }
 
+// Total number of bytes of memory used by the deck for audio
+unsigned long get_memory_usage()
+{
+	unsigned long total = 0;
+	
+	if (ringbuffer[0]) total += ringbuffer[0]->size;
+	if (ringbuffer[1]) total += ringbuffer[1]->size;
+	if (input_file) {
+		total += input_file->buffer_size;
+		total += input_file->preload_size;
+	}
+	total += cart_memory_usage();
+	total += hotcue_memory_usage();
+	total += seek_memory_usage();
+	total += loop_memory_usage();
+	total += playlist_memory_usage();
+	
+	return total;
+}
+
 enum madjack_state get_state()
 {
 	return state;
@@ -341,12 +521,19 @@ void set_state( enum madjack_state new_state )
 			printf("State: %s          \n",get_state_name(new_state));
 		}
 		state = new_state;
+		status_update( 0 );
 		
+		// Any other change means the deck is no longer parked
+		warm_stopped = 0;
 		
-		if (state == MADJACK_STATE_PLAYING) {
-			jack_transport_start( client );
-		} else {
-			jack_transport_stop( client );
+		// (there is no JACK client when rendering,
+		// and when following the transport we don't drive it)
+		if (client && !transport_follow) {
+			if (state == MADJACK_STATE_PLAYING) {
+				jack_transport_start( client );
+			} else {
+				jack_transport_stop( client );
+			}
 		}
 	}
 	
@@ -372,7 +559,24 @@ void usage()
 	printf("   -j            Don't automatically start jackd\n");
 	printf("   -d <dir>      Set root directory for audio files\n");
 	printf("   -p <port>     Specify port to listen for OSC messages on\n");
+	printf("   -T <port>     Also listen for OSC messages on this TCP port\n");
+	printf("   -U <path>     Also listen for OSC messages on this Unix socket\n");
+	printf("   -M <addr:port> Send state changes to a multicast group\n");
 	printf("   -R <secs>     Set duration of ringbuffer (in seconds)\n");
+	printf("   -b <secs>     Let ringbuffer adapt down to this size (in seconds)\n");
+	printf("   -L            Lock audio buffers into memory\n");
+	printf("   -H            Use huge pages for audio buffers\n");
+	printf("   -P [rr:]<pri> Real-time priority for the decoder thread\n");
+	printf("   -C <cpus>     CPUs to run the decoder thread on (eg 2,3)\n");
+	printf("   -O <cpus>     CPUs to run the OSC server thread on\n");
+	printf("   -D <secs>     Raise decoder priority below this much audio\n");
+	printf("   -o <file>     Render <filepath> to a WAV file without using JACK\n");
+	printf("   -t            Follow JACK transport (start, stop and locate)\n");
+	printf("   -m            Preload whole of each file into memory\n");
+	printf("   -w            Warm stop: keep decoded audio when stopping\n");
+	printf("   -A <secs>     Read ahead of the decoder in a separate thread\n");
+	printf("   -c <secs>     Decode tracks shorter than this into memory (carts)\n");
+	printf("   -S <MB>       Share decoded carts with other processes\n");
 	printf("   -v            Enable verbose mode\n");
 	printf("   -q            Enable quiet mode\n");
 	printf("\n");
@@ -390,13 +594,14 @@ int main(int argc, char *argv[])
 	char *connect_right = NULL;
 	lo_server_thread osc_thread = NULL;
 	char *osc_port = NULL;
+	char *render_path = NULL;
 	int opt;
 
 	// Make STDOUT unbuffered
 	setbuf(stdout, NULL);
 
 	// Parse Switches
-	while ((opt = getopt(argc, argv, "al:r:n:jd:p:R:vqh")) != -1) {
+	while ((opt = getopt(argc, argv, "al:r:n:jd:p:T:U:M:R:b:LHP:C:O:D:o:tmwA:c:S:vqh")) != -1) {
 		switch (opt) {
 			case 'a':  autoconnect = 1; break;
 			case 'l':  connect_left = optarg; break;
@@ -405,7 +610,24 @@ int main(int argc, char *argv[])
 			case 'j':  jack_opt |= JackNoStartServer; break;
 			case 'd':  root_directory = optarg; break;
 			case 'p':  osc_port = optarg; break;
+			case 'T':  osc_tcp_port = optarg; break;
+			case 'U':  osc_unix_path = optarg; break;
+			case 'M':  if (parse_multicast(optarg)) usage(); break;
 			case 'R':  rb_duration = atof(optarg); break;
+			case 'b':  rb_min_duration = atof(optarg); break;
+			case 'L':  rtmem_lock = 1; break;
+			case 'H':  rtmem_huge = 1; break;
+			case 'P':  if (parse_decoder_priority(optarg)) usage(); break;
+			case 'C':  if (parse_decoder_cpus(optarg)) usage(); break;
+			case 'O':  if (parse_osc_cpus(optarg)) usage(); break;
+			case 'D':  danger_duration = atof(optarg); break;
+			case 'o':  render_path = optarg; break;
+			case 't':  transport_follow = 1; break;
+			case 'm':  preload = 1; break;
+			case 'w':  warm_stop = 1; break;
+			case 'A':  readahead_duration = atof(optarg); break;
+			case 'c':  cart_duration = atof(optarg); break;
+			case 'S':  pcmcache_budget = atof(optarg); break;
 			case 'v':  verbose = 1; break;
 			case 'q':  quiet = 1; break;
 			default:  usage(); break;
@@ -426,12 +648,39 @@ int main(int argc, char *argv[])
     	fprintf(stderr, "%s only takes a single, optional, filepath argument.\n", PACKAGE_NAME);
     	usage();
 	}
+	
+	// Render to a file, instead of playing ?
+	if (render_path) {
+		int result;
+		
+		if (argc!=1) {
+			fprintf(stderr, "A filepath is needed to render.\n");
+			usage();
+		}
+		input_file = init_inputfile();
+		result = render_to_file( *argv, render_path );
+		finish_inputfile( input_file );
+		return result;
+	}
 
 	// Initialise JACK
 	init_jack( client_name, jack_opt );
 
+	// Check that thread priorities can be applied
+	init_rtsched();
+
+	// Work out the bounds for adaptive ringbuffer sizing
+	init_rbsize();
+
 	// Initialse Input File Data Structure
 	input_file = init_inputfile();
+	
+	// Create the read-ahead window
+	init_readahead();
+	
+	// Create the memory that carts are decoded into
+	init_cart();
+	if (cart_duration > 0.0f) init_pcmcache();
 
 	// Activate JACK
 	if (jack_activate(client)) {
@@ -450,7 +699,9 @@ int main(int argc, char *argv[])
 	if (connect_left) connect_jack_port( outport[0], connect_left );
 	if (connect_right) connect_jack_port( outport[1], connect_right );
 
-	// Initialise LibLO
+	// Start carrying out commands, then start receiving them
+	init_command();
+	init_playlist();
 	osc_thread = init_osc( osc_port );
 
 
@@ -458,7 +709,11 @@ int main(int argc, char *argv[])
 	set_state( MADJACK_STATE_EMPTY );
     
 	// Load an initial track ?
-	if (argc) do_load( *argv );
+	if (argc) do_load( *argv, preload );
+	
+	// Start following the transport
+	init_transport();
+	init_schedule();
 
 
 	// Handle user keypresses (main loop)
@@ -467,16 +722,30 @@ int main(int argc, char *argv[])
 
 	// Shut down LibLO
 	if (osc_thread) finish_osc( osc_thread );
+	finish_command();
 
 	// Wait for decoder thread to terminate
+	finish_transport();
+	finish_schedule();
 	finish_decoder_thread();
+	finish_readahead();
 	
 	// Clean up JACK
 	finish_jack();
+	finish_jackstats();
+	finish_group();
+	finish_status();
+	finish_cart();
+	finish_pcmcache();
+	finish_hotcues();
+	finish_seek();
+	finish_loop();
+	finish_playlist();
 	
 	
 	// Clean up data structure memory
 	finish_inputfile( input_file );
+	finish_rtmem();
 	
 
 	return 0;
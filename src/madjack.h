@@ -20,6 +20,8 @@
 
 */
 
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <jack/jack.h>
 #include <jack/ringbuffer.h>
 
@@ -55,6 +57,10 @@ typedef struct input_file_struct {
 	unsigned int buffer_used;		// Amount of buffer currently used
 	
 	FILE* file;
+	struct stat file_stat;				// Identity of the file that was opened
+	char* fullpath;						// Path to the audio file (including root directory)
+	unsigned char* preload_buffer;		// Whole file in memory (when preloaded)
+	unsigned long preload_size;			// Length of preload buffer (in bytes)
 	char* filepath;						// Path to the audio file
 	char filename[MAX_FILENAME_LEN];	// Filename without the path
 	unsigned long start_pos;			// First byte of MPEG audio
@@ -66,10 +72,19 @@ typedef struct input_file_struct {
 	int bitrate;						// Bitrate of the input file (in kbps)
 	int samplerate;						// Sample rate of the input file (in Hz)
 	int framesize;						// Length of a frame of audio (in bytes)
+	unsigned int skip_frames;			// Frames to decode but not output (after a seek)
 
 } input_file_t;
 
 
+typedef struct pcm_buffer_struct {
+	float* samples[2];					// Decoded audio for each channel
+	unsigned int length;				// Number of frames in the buffer
+	unsigned int capacity;				// Number of frames the buffer can hold
+	int locked;							// Set if the samples are locked in memory
+} pcm_buffer_t;
+
+
 // ------- Globals -------
 extern jack_port_t *outport[2];
 extern jack_ringbuffer_t *ringbuffer[2];
@@ -78,6 +93,11 @@ extern input_file_t *input_file;
 extern char * root_directory;
 extern char error_string[MAX_ERRORSTR_LEN];
 extern int play_when_ready;
+extern int preload;
+extern float rb_duration;
+extern int warm_stop;
+extern int warm_stopped;
+extern int freewheeling;
 extern int verbose;
 extern int quiet;
 
@@ -86,6 +106,7 @@ extern int quiet;
 enum madjack_state get_state();
 void set_state( enum madjack_state new_state );
 const char* get_state_name( enum madjack_state state );
+unsigned long get_memory_usage();
 void error_handler( char *fmt, ... );
 
 
@@ -29,12 +29,44 @@
 
 #include <lo/lo.h>
 
-#include "control.h"
+#include "command.h"
 #include "madjack.h"
 #include "mjosc.h"
+#include "readahead.h"
+#include "pcmcache.h"
+#include "rbsize.h"
+#include "jackstats.h"
+#include "schedule.h"
+#include "group.h"
+#include "subscribe.h"
+#include "playlist.h"
+#include "status.h"
+#include "oscreply.h"
+#include "rtsched.h"
 #include "config.h"
 
 
+// ------- Globals -------
+char *osc_tcp_port = NULL;					// TCP port to also listen on
+char *osc_unix_path = NULL;					// Unix domain socket to also listen on
+
+static lo_server_thread tcp_thread = NULL;
+static lo_server_thread unix_thread = NULL;
+
+// Replies to the common queries, built once
+static osc_reply_t state_reply;
+static osc_reply_t status_reply;
+static osc_reply_t position_reply;
+static osc_reply_t duration_reply;
+static osc_reply_t filepath_reply;
+static osc_reply_t error_reply;
+static osc_reply_t version_reply;
+static osc_reply_t osc_stats_reply;
+static osc_reply_t pong_reply;
+static osc_reply_t pong_seq_reply;
+
+
+
 static
 void osc_error_handler(int num, const char *msg, const char *path)
 {
@@ -42,27 +74,122 @@ void osc_error_handler(int num, const char *msg, const char *path)
     fflush(stdout);
 }
 
+// Work out the JACK time and frame time that a message's timetag refers to
+// Returns 0 if the message isn't timetagged, and should be acted on now
+static
+int timetag_to_frame( lo_message msg, command_t *cmd, float *margin )
+{
+	lo_timetag tt = lo_message_get_timestamp( msg );
+	lo_timetag now;
+	double delay;
+	
+	// Not in a bundle, or in one to be dispatched immediately
+	if (tt.sec == 0 && tt.frac == 1) return 0;
+	
+	// Both clocks move at the same rate, so map across at the current time
+	lo_timetag_now( &now );
+	delay = lo_timetag_diff( tt, now );
+	cmd->time = (jack_time_t)((double)jack_get_time() + delay * 1000000.0);
+	cmd->frame = jack_time_to_frames( client, cmd->time );
+	*margin = delay;
+	
+	return 1;
+}
+
+// Queue a command for the control worker, to be acknowledged if
+// there is a request id after its 'nargs' arguments
+static
+int submit_command( command_t *cmd, const char *types, lo_arg **argv, int argc,
+		 int nargs, lo_message msg, void *user_data )
+{
+	// liblo will coerce a float into the request id of the first method that
+	// fits, so pass it on to the method that takes it as a float instead
+	if (argc > nargs && lo_message_get_types( msg )[nargs] != LO_INT32) return 1;
+
+	if (argc > nargs && types[nargs] == LO_INT32) {
+		command_reply_to( cmd, argv[nargs]->i, lo_message_get_source( msg ), (lo_server)user_data );
+	}
+	
+	command_submit( cmd );
+	return 0;
+}
+
 static
 int play_handler(const char *path, const char *types, lo_arg **argv, int argc,
 		 lo_message msg, void *user_data)
 {
-	do_play();
-    return 0;
+	command_t cmd;
+	float margin;
+	
+	command_init( &cmd, COMMAND_PLAY );
+	if (timetag_to_frame( msg, &cmd, &margin )) {
+		cmd.type = COMMAND_PLAY_AT;
+		cmd.value[0] = margin;
+	}
+	return submit_command( &cmd, types, argv, argc, 0, msg, user_data );
 }
 
 static
 int pause_handler(const char *path, const char *types, lo_arg **argv, int argc,
 		 lo_message msg, void *user_data)
 {
-	do_pause();
-    return 0;
+	command_t cmd;
+	
+	command_init( &cmd, COMMAND_PAUSE );
+	return submit_command( &cmd, types, argv, argc, 0, msg, user_data );
 }
 
 static
 int stop_handler(const char *path, const char *types, lo_arg **argv, int argc,
 		 lo_message msg, void *user_data)
 {
-	do_stop();
+	command_t cmd;
+	float margin;
+	
+	command_init( &cmd, COMMAND_STOP );
+	if (timetag_to_frame( msg, &cmd, &margin )) {
+		cmd.type = COMMAND_STOP_AT;
+	}
+	return submit_command( &cmd, types, argv, argc, 0, msg, user_data );
+}
+
+static
+int group_arm_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	command_t cmd;
+	
+	command_init( &cmd, COMMAND_GROUP_ARM );
+	if (command_set_name( &cmd, &argv[0]->s )) return 0;
+	command_submit( &cmd );
+    return 0;
+}
+
+static
+int group_disarm_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	command_t cmd;
+	
+	command_init( &cmd, COMMAND_GROUP_DISARM );
+	command_submit( &cmd );
+    return 0;
+}
+
+static
+int group_play_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	command_t cmd;
+	float margin;
+	
+	// (the group the deck is armed in, if none is given)
+	command_init( &cmd, COMMAND_GROUP_PLAY );
+	if (argc && command_set_name( &cmd, &argv[0]->s )) return 0;
+	
+	// Timetagged, or as soon as all the decks can be sure to see it
+	timetag_to_frame( msg, &cmd, &margin );
+	command_submit( &cmd );
     return 0;
 }
 
@@ -70,49 +197,284 @@ static
 int cue_handler(const char *path, const char *types, lo_arg **argv, int argc,
 		 lo_message msg, void *user_data)
 {
-	if (strcmp( types, "f" )==0) {
-		do_cue(argv[0]->f);
-	} else {
-		do_cue(0.0f);
+	command_t cmd;
+	int nargs = 0;
+	
+	command_init( &cmd, COMMAND_CUE );
+	if (types[0] == LO_FLOAT) {
+		cmd.value[0] = argv[0]->f;
+		nargs = 1;
 	}
-    return 0;
+	return submit_command( &cmd, types, argv, argc, nargs, msg, user_data );
+}
+
+static
+int seek_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	command_t cmd;
+	
+	command_init( &cmd, COMMAND_SEEK );
+	cmd.value[0] = argv[0]->f;
+	return submit_command( &cmd, types, argv, argc, 1, msg, user_data );
+}
+
+static
+int loop_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	command_t cmd;
+	int nargs = 0;
+	
+	// Start, end and optionally a fade
+	command_init( &cmd, COMMAND_LOOP );
+	while (nargs < 3 && nargs < argc && types[nargs] == LO_FLOAT) {
+		cmd.value[nargs] = argv[nargs]->f;
+		nargs++;
+	}
+	return submit_command( &cmd, types, argv, argc, nargs, msg, user_data );
+}
+
+static
+int unloop_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	command_t cmd;
+	
+	command_init( &cmd, COMMAND_UNLOOP );
+	return submit_command( &cmd, types, argv, argc, 0, msg, user_data );
+}
+
+static
+int set_hotcue_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	command_t cmd;
+	
+	command_init( &cmd, COMMAND_SET_HOTCUE );
+	cmd.index = argv[0]->i;
+	cmd.value[0] = argv[1]->f;
+	return submit_command( &cmd, types, argv, argc, 2, msg, user_data );
+}
+
+static
+int fire_hotcue_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	command_t cmd;
+	
+	command_init( &cmd, COMMAND_FIRE_HOTCUE );
+	cmd.index = argv[0]->i;
+	return submit_command( &cmd, types, argv, argc, 1, msg, user_data );
 }
 
 static
 int eject_handler(const char *path, const char *types, lo_arg **argv, int argc,
 		 lo_message msg, void *user_data)
 {
-	do_eject();
-    return 0;
+	command_t cmd;
+	
+	command_init( &cmd, COMMAND_EJECT );
+	return submit_command( &cmd, types, argv, argc, 0, msg, user_data );
 }
 
 static
 int load_handler(const char *path, const char *types, lo_arg **argv, int argc,
 		 lo_message msg, void *user_data)
 {
+	command_t cmd;
+
 	// Double check arguments
-	if (argc!=1 || types[0] != LO_STRING) {
-		fprintf(stderr, "Error: was expecting single string argument to /deck/load\n");
+	if (argc<1 || types[0] != LO_STRING) {
+		fprintf(stderr, "Error: was expecting string argument to /deck/load\n");
 		return -1;
 	}
 
 	// Load the requested track
-	do_load( &argv[0]->s );
+	command_init( &cmd, COMMAND_LOAD );
+	if (command_set_name( &cmd, &argv[0]->s )) return 0;
+	return submit_command( &cmd, types, argv, argc, 1, msg, user_data );
+}
+
+static
+int preload_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	command_t cmd;
+
+	// Double check arguments
+	if (argc<1 || types[0] != LO_STRING) {
+		fprintf(stderr, "Error: was expecting string argument to /deck/preload\n");
+		return -1;
+	}
+
+	// Load the requested track into memory
+	command_init( &cmd, COMMAND_PRELOAD );
+	if (command_set_name( &cmd, &argv[0]->s )) return 0;
+	return submit_command( &cmd, types, argv, argc, 1, msg, user_data );
+}
+
+
+static
+int queue_add_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	playlist_add( &argv[0]->s );
+    return 0;
+}
+
+static
+int queue_insert_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	if (argv[0]->i < 0) {
+		fprintf(stderr, "Error: position in the queue can't be negative\n");
+		return 0;
+	}
+
+	playlist_insert( argv[0]->i, &argv[1]->s );
+    return 0;
+}
+
+static
+int queue_remove_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	if (argv[0]->i >= 0) playlist_remove( argv[0]->i );
+    return 0;
+}
+
+static
+int queue_clear_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	playlist_clear();
+    return 0;
+}
+
+static
+int queue_get_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	lo_address src = lo_message_get_source( msg );
+	lo_server serv = (lo_server)user_data;
+	lo_message reply = lo_message_new();
+	unsigned int count = 0, i;
+	char **items = playlist_copy( &count );
+	int result;
+	
+	// One string argument per queued track
+	for (i=0; i<count; i++) {
+		lo_message_add_string( reply, items[i] );
+		free( items[i] );
+	}
+	free( items );
+	
+	// Send back reply
+	result = lo_send_message_from( src, serv, "/queue/items", reply );
+	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
+	lo_message_free( reply );
+
+    return 0;
+}
+
+static
+int queue_crossfade_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	playlist_set_crossfade( argv[0]->f );
+    return 0;
+}
+
+static
+int queue_get_crossfade_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	lo_address src = lo_message_get_source( msg );
+	lo_server serv = (lo_server)user_data;
+	int result;
+	
+	// Send back reply
+	result = lo_send_from( src, serv, LO_TT_IMMEDIATE, "/queue/crossfade", "f",
+	                       playlist_get_crossfade() );
+	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
+
     return 0;
 }
 
 
+static
+int subscribe_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	lo_address src = lo_message_get_source( msg );
+	int interval = (argc >= 1) ? argv[0]->i : 0;
+	int lease = (argc >= 2) ? argv[1]->i : 0;
+	
+	// Updates are sent as datagrams, so can't go back down a TCP connection
+	if (lo_address_get_protocol( src ) == LO_TCP) {
+		fprintf(stderr, "Warning: subscriptions can only be made over UDP or a Unix socket.\n");
+		return 0;
+	}
+	
+	// (subscribing again just renews it, so there are no duplicates to worry about)
+	if (add_subscriber( src, (lo_server)user_data, interval, lease ) == 0 && argc >= 3) {
+		command_acknowledge( src, (lo_server)user_data, argv[2]->i, get_state() );
+	}
+    return 0;
+}
+
+static
+int unsubscribe_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	lo_address src = lo_message_get_source( msg );
+	
+	remove_subscriber( src );
+	if (argc >= 1) command_acknowledge( src, (lo_server)user_data, argv[0]->i, get_state() );
+    return 0;
+}
+
 static
 int state_handler(const char *path, const char *types, lo_arg **argv, int argc,
 		 lo_message msg, void *user_data)
 {
 	lo_address src = lo_message_get_source( msg );
 	lo_server serv = (lo_server)user_data;
+	osc_reply_t reply;
+	int result;
+	
+	// Send back reply
+	osc_reply_begin( &reply, &state_reply );
+	osc_reply_add_string( &reply, get_state_name( get_state() ) );
+	result = osc_reply_send( &reply, src, serv );
+	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
+
+    return 0;
+}
+
+static
+int status_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	lo_address src = lo_message_get_source( msg );
+	lo_server serv = (lo_server)user_data;
+	deck_status_t status;
+	osc_reply_t reply;
 	int result;
 	
+	get_status( &status );
+	
 	// Send back reply
-	result = lo_send_from( src, serv, LO_TT_IMMEDIATE,
-	              "/deck/state", "s", get_state_name( get_state() ) );
+	osc_reply_begin( &reply, &status_reply );
+	osc_reply_add_string( &reply, status.state_name );
+	osc_reply_add_float( &reply, status.position );
+	osc_reply_add_int32( &reply, (int)status.position_samples );
+	osc_reply_add_float( &reply, status.duration );
+	osc_reply_add_string( &reply, status.filepath );
+	osc_reply_add_float( &reply, status.buffered * 1000.0f );
+	osc_reply_add_string( &reply, status.error );
+	result = osc_reply_send( &reply, src, serv );
 	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
 
     return 0;
@@ -124,11 +486,16 @@ int position_handler(const char *path, const char *types, lo_arg **argv, int arg
 {
 	lo_address src = lo_message_get_source( msg );
 	lo_server serv = (lo_server)user_data;
+	deck_status_t status;
+	osc_reply_t reply;
 	int result;
 	
+	get_status( &status );
+	
 	// Send back reply
-	result = lo_send_from( src, serv, LO_TT_IMMEDIATE,
-	              "/deck/position", "f", input_file->position );
+	osc_reply_begin( &reply, &position_reply );
+	osc_reply_add_float( &reply, status.position );
+	result = osc_reply_send( &reply, src, serv );
 	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
 
     return 0;
@@ -140,11 +507,16 @@ int duration_handler(const char *path, const char *types, lo_arg **argv, int arg
 {
 	lo_address src = lo_message_get_source( msg );
 	lo_server serv = (lo_server)user_data;
+	deck_status_t status;
+	osc_reply_t reply;
 	int result;
 	
+	get_status( &status );
+	
 	// Send back reply
-	result = lo_send_from( src, serv, LO_TT_IMMEDIATE,
-	              "/deck/duration", "f", input_file->duration );
+	osc_reply_begin( &reply, &duration_reply );
+	osc_reply_add_float( &reply, status.duration );
+	result = osc_reply_send( &reply, src, serv );
 	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
 
     return 0;
@@ -156,16 +528,185 @@ int filepath_handler(const char *path, const char *types, lo_arg **argv, int arg
 {
 	lo_address src = lo_message_get_source( msg );
 	lo_server serv = (lo_server)user_data;
+	deck_status_t status;
+	osc_reply_t reply;
 	int result;
+	
+	get_status( &status );
 
+	// Send back reply (empty if there's no track)
+	osc_reply_begin( &reply, &filepath_reply );
+	osc_reply_add_string( &reply, status.filepath );
+	result = osc_reply_send( &reply, src, serv );
+	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
+
+    return 0;
+}
+
+static
+int memory_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	lo_address src = lo_message_get_source( msg );
+	lo_server serv = (lo_server)user_data;
+	int result;
+	
 	// Send back reply
-	if (input_file->filepath) {
-		result = lo_send_from( src, serv, LO_TT_IMMEDIATE,
-					  "/deck/filepath", "s", input_file->filepath );
-	} else {
-		// Empty filepath
-		result = lo_send_from( src, serv, LO_TT_IMMEDIATE, "/deck/filepath", "s", "" );
+	result = lo_send_from( src, serv, LO_TT_IMMEDIATE, "/deck/memory", "hh",
+	              (int64_t)input_file->preload_size, (int64_t)get_memory_usage() );
+	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
+
+    return 0;
+}
+
+static
+int read_latency_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	lo_address src = lo_message_get_source( msg );
+	lo_server serv = (lo_server)user_data;
+	int result;
+	
+	// Send back reply
+	result = lo_send_from( src, serv, LO_TT_IMMEDIATE, "/deck/read_latency", "ffffi",
+	              get_read_latency_percentile( 50.0f ),
+	              get_read_latency_percentile( 90.0f ),
+	              get_read_latency_percentile( 99.0f ),
+	              get_read_latency_max(),
+	              (int)get_readahead_starved() );
+	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
+
+    return 0;
+}
+
+static
+int cache_stats_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	lo_address src = lo_message_get_source( msg );
+	lo_server serv = (lo_server)user_data;
+	unsigned long hits, misses, evictions;
+	unsigned long long used, budget;
+	int result;
+	
+	pcmcache_get_stats( &hits, &misses, &evictions, &used, &budget );
+	
+	// Send back reply
+	result = lo_send_from( src, serv, LO_TT_IMMEDIATE, "/deck/cache_stats", "hhhhh",
+	              (int64_t)hits, (int64_t)misses, (int64_t)evictions,
+	              (int64_t)used, (int64_t)budget );
+	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
+
+    return 0;
+}
+
+static
+int ringbuffer_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	lo_address src = lo_message_get_source( msg );
+	lo_server serv = (lo_server)user_data;
+	lo_message reply = lo_message_new();
+	float history[RBSIZE_HISTORY];
+	float target, margin, refill;
+	unsigned long capacity;
+	int i, result;
+	
+	rbsize_get_stats( &target, &capacity, &margin, &refill, history );
+	
+	lo_message_add_float( reply, target );
+	lo_message_add_int32( reply, (int)capacity );
+	lo_message_add_float( reply, margin );
+	lo_message_add_float( reply, refill * 1000.0f );
+	for (i=0; i<RBSIZE_HISTORY; i++) {
+		lo_message_add_float( reply, history[i] );
 	}
+	
+	// Send back reply
+	result = lo_send_message_from( src, serv, "/deck/ringbuffer", reply );
+	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
+	lo_message_free( reply );
+
+    return 0;
+}
+
+static
+int latency_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	lo_address src = lo_message_get_source( msg );
+	lo_server serv = (lo_server)user_data;
+	jack_nframes_t min, max, period;
+	int result;
+	
+	jackstats_get_latency( &min, &max, &period );
+	
+	// Send back reply
+	result = lo_send_from( src, serv, LO_TT_IMMEDIATE, "/deck/latency", "iii",
+	                       (int)min, (int)max, (int)period );
+	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
+
+    return 0;
+}
+
+static
+int xruns_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	lo_address src = lo_message_get_source( msg );
+	lo_server serv = (lo_server)user_data;
+	unsigned long total, playing, low_fill;
+	float min_fill, max_delay;
+	const char *last_state;
+	int result;
+	
+	jackstats_get_xruns( &total, &playing, &low_fill, &min_fill, &max_delay, &last_state );
+	
+	// Send back reply
+	result = lo_send_from( src, serv, LO_TT_IMMEDIATE, "/deck/xruns", "iiiffs",
+	                       (int)total, (int)playing, (int)low_fill, min_fill, max_delay, last_state );
+	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
+
+    return 0;
+}
+
+static
+int schedule_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	lo_address src = lo_message_get_source( msg );
+	lo_server serv = (lo_server)user_data;
+	unsigned long starts, late, measured, p99, max;
+	long median;
+	float margin;
+	int result;
+	
+	schedule_get_stats( &starts, &late, &measured, &median, &p99, &max, &margin );
+	
+	// Send back reply
+	result = lo_send_from( src, serv, LO_TT_IMMEDIATE, "/deck/schedule", "hhhiiif",
+	                       (int64_t)starts, (int64_t)late, (int64_t)measured,
+	                       (int)median, (int)p99, (int)max, margin * 1000.0f );
+	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
+
+    return 0;
+}
+
+static
+int group_state_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	lo_address src = lo_message_get_source( msg );
+	lo_server serv = (lo_server)user_data;
+	unsigned int armed, started;
+	jack_nframes_t spread;
+	int result;
+	
+	if (group_get_state( &argv[0]->s, &armed, &started, &spread )) return 0;
+	
+	// Send back reply
+	result = lo_send_from( src, serv, LO_TT_IMMEDIATE, "/group/state", "siii",
+	                       &argv[0]->s, (int)armed, (int)started, (int)spread );
 	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
 
     return 0;
@@ -177,17 +718,23 @@ int ping_handler(const char *path, const char *types, lo_arg **argv, int argc,
 {
 	lo_address src = lo_message_get_source( msg );
 	lo_server serv = (lo_server)user_data;
+	osc_reply_t reply;
 	int result;
 	
 	// Display the address the ping came from
 	if (verbose) {
-		char *url = lo_address_get_url(src);
-		printf( "Got ping from: %s\n", url);
-		free(url);
+		const char *host = lo_address_get_hostname( src );
+		printf( "Got ping from: %s:%s\n", host ? host : "", lo_address_get_port( src ));
 	}
 
-	// Send back reply
-	result = lo_send_from( src, serv, LO_TT_IMMEDIATE, "/pong", "" );
+	// Send back reply (with the ping's sequence number, if it had one)
+	if (argc) {
+		osc_reply_begin( &reply, &pong_seq_reply );
+		osc_reply_add_int32( &reply, argv[0]->i );
+	} else {
+		osc_reply_begin( &reply, &pong_reply );
+	}
+	result = osc_reply_send( &reply, src, serv );
 	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
 
     return 0;
@@ -199,10 +746,13 @@ int get_error_handler(const char *path, const char *types, lo_arg **argv, int ar
 {
 	lo_address src = lo_message_get_source( msg );
 	lo_server serv = (lo_server)user_data;
+	osc_reply_t reply;
 	int result;
 	
 	// Send back reply
-	result = lo_send_from( src, serv, LO_TT_IMMEDIATE, "/error", "s", error_string );
+	osc_reply_begin( &reply, &error_reply );
+	osc_reply_add_string( &reply, error_string );
+	result = osc_reply_send( &reply, src, serv );
 	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
 
     return 0;
@@ -214,10 +764,36 @@ int get_version_handler(const char *path, const char *types, lo_arg **argv, int
 {
 	lo_address src = lo_message_get_source( msg );
 	lo_server serv = (lo_server)user_data;
+	osc_reply_t reply;
+	int result;
+	
+	// Send back reply
+	osc_reply_begin( &reply, &version_reply );
+	osc_reply_add_string( &reply, PACKAGE_NAME );
+	osc_reply_add_string( &reply, PACKAGE_VERSION );
+	result = osc_reply_send( &reply, src, serv );
+	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
+
+    return 0;
+}
+
+static
+int osc_stats_handler(const char *path, const char *types, lo_arg **argv, int argc,
+		 lo_message msg, void *user_data)
+{
+	lo_address src = lo_message_get_source( msg );
+	lo_server serv = (lo_server)user_data;
+	unsigned long direct, fallback;
+	osc_reply_t reply;
 	int result;
 	
+	osc_reply_get_stats( &direct, &fallback );
+	
 	// Send back reply
-	result = lo_send_from( src, serv, LO_TT_IMMEDIATE, "/version", "ss", PACKAGE_NAME, PACKAGE_VERSION );
+	osc_reply_begin( &reply, &osc_stats_reply );
+	osc_reply_add_int32( &reply, (int)direct );
+	osc_reply_add_int32( &reply, (int)fallback );
+	result = osc_reply_send( &reply, src, serv );
 	if (result<1) fprintf(stderr, "Error: sending reply failed: %s\n", lo_address_errstr(src));
 
     return 0;
@@ -236,37 +812,94 @@ int wildcard_handler(const char *path, const char *types, lo_arg **argv, int arg
 
 
 
-lo_server_thread init_osc( char *port )
+// Create a server thread for one protocol, add our methods and start it
+static
+lo_server_thread start_server( const char *port, int proto )
 {
 	lo_server_thread st = NULL;
 	lo_server serv = NULL;
 	
 	// Create new server
-	st = lo_server_thread_new( port, osc_error_handler );
+	st = lo_server_thread_new_with_proto( port, proto, osc_error_handler );
 	if (!st) return NULL;
 	
 	// Add the methods
 	serv = lo_server_thread_get_server( st );
+#ifdef HAVE_LO_SERVER_ENABLE_QUEUE
+	// Pass on timetagged bundles as they arrive, rather than holding them
+	// until they are due, so that they can be scheduled to the sample
+	lo_server_enable_queue( serv, 0, 1 );
+#endif
 	lo_server_thread_add_method( st, "/deck/play", "", play_handler, serv);
+	lo_server_thread_add_method( st, "/deck/play", "i", play_handler, serv);
 	lo_server_thread_add_method( st, "/deck/pause", "", pause_handler, serv);
+	lo_server_thread_add_method( st, "/deck/pause", "i", pause_handler, serv);
 	lo_server_thread_add_method( st, "/deck/stop", "", stop_handler, serv);
+	lo_server_thread_add_method( st, "/deck/stop", "i", stop_handler, serv);
+	lo_server_thread_add_method( st, "/group/arm", "s", group_arm_handler, serv);
+	lo_server_thread_add_method( st, "/group/disarm", "", group_disarm_handler, serv);
+	lo_server_thread_add_method( st, "/group/play", "", group_play_handler, serv);
+	lo_server_thread_add_method( st, "/group/play", "s", group_play_handler, serv);
+	lo_server_thread_add_method( st, "/group/get_state", "s", group_state_handler, serv);
 	lo_server_thread_add_method( st, "/deck/cue", "", cue_handler, serv);
 	lo_server_thread_add_method( st, "/deck/cue", "f", cue_handler, serv);
+	lo_server_thread_add_method( st, "/deck/cue", "fi", cue_handler, serv);
+	lo_server_thread_add_method( st, "/deck/seek", "f", seek_handler, serv);
+	lo_server_thread_add_method( st, "/deck/seek", "fi", seek_handler, serv);
+	lo_server_thread_add_method( st, "/deck/loop", "ff", loop_handler, serv);
+	lo_server_thread_add_method( st, "/deck/loop", "ffi", loop_handler, serv);
+	lo_server_thread_add_method( st, "/deck/loop", "fff", loop_handler, serv);
+	lo_server_thread_add_method( st, "/deck/loop", "fffi", loop_handler, serv);
+	lo_server_thread_add_method( st, "/deck/loop/exit", "", unloop_handler, serv);
+	lo_server_thread_add_method( st, "/deck/loop/exit", "i", unloop_handler, serv);
+	lo_server_thread_add_method( st, "/deck/hotcue/set", "if", set_hotcue_handler, serv);
+	lo_server_thread_add_method( st, "/deck/hotcue/set", "ifi", set_hotcue_handler, serv);
+	lo_server_thread_add_method( st, "/deck/hotcue/fire", "i", fire_hotcue_handler, serv);
+	lo_server_thread_add_method( st, "/deck/hotcue/fire", "ii", fire_hotcue_handler, serv);
 	lo_server_thread_add_method( st, "/deck/eject", "", eject_handler, serv);
+	lo_server_thread_add_method( st, "/deck/eject", "i", eject_handler, serv);
 	lo_server_thread_add_method( st, "/deck/load", "s", load_handler, serv);
+	lo_server_thread_add_method( st, "/deck/load", "si", load_handler, serv);
+	lo_server_thread_add_method( st, "/deck/preload", "s", preload_handler, serv);
+	lo_server_thread_add_method( st, "/deck/preload", "si", preload_handler, serv);
+	lo_server_thread_add_method( st, "/queue/add", "s", queue_add_handler, serv);
+	lo_server_thread_add_method( st, "/queue/insert", "is", queue_insert_handler, serv);
+	lo_server_thread_add_method( st, "/queue/remove", "i", queue_remove_handler, serv);
+	lo_server_thread_add_method( st, "/queue/clear", "", queue_clear_handler, serv);
+	lo_server_thread_add_method( st, "/queue/get", "", queue_get_handler, serv);
+	lo_server_thread_add_method( st, "/queue/crossfade", "f", queue_crossfade_handler, serv);
+	lo_server_thread_add_method( st, "/queue/get_crossfade", "", queue_get_crossfade_handler, serv);
 	lo_server_thread_add_method( st, "/deck/get_state", "", state_handler, serv);
 	lo_server_thread_add_method( st, "/deck/get_duration", "", duration_handler, serv);
 	lo_server_thread_add_method( st, "/deck/get_position", "", position_handler, serv);
+	lo_server_thread_add_method( st, "/deck/get_status", "", status_handler, serv);
 	lo_server_thread_add_method( st, "/deck/get_filepath", "", filepath_handler, serv);
+	lo_server_thread_add_method( st, "/deck/get_memory", "", memory_handler, serv);
+	lo_server_thread_add_method( st, "/deck/get_read_latency", "", read_latency_handler, serv);
+	lo_server_thread_add_method( st, "/deck/get_cache_stats", "", cache_stats_handler, serv);
+	lo_server_thread_add_method( st, "/deck/get_ringbuffer", "", ringbuffer_handler, serv);
+	lo_server_thread_add_method( st, "/deck/get_latency", "", latency_handler, serv);
+	lo_server_thread_add_method( st, "/deck/get_xruns", "", xruns_handler, serv);
+	lo_server_thread_add_method( st, "/deck/get_schedule", "", schedule_handler, serv);
+	lo_server_thread_add_method( st, "/deck/subscribe", "", subscribe_handler, serv);
+	lo_server_thread_add_method( st, "/deck/subscribe", "i", subscribe_handler, serv);
+	lo_server_thread_add_method( st, "/deck/subscribe", "ii", subscribe_handler, serv);
+	lo_server_thread_add_method( st, "/deck/subscribe", "iii", subscribe_handler, serv);
+	lo_server_thread_add_method( st, "/deck/unsubscribe", "", unsubscribe_handler, serv);
+	lo_server_thread_add_method( st, "/deck/unsubscribe", "i", unsubscribe_handler, serv);
 	lo_server_thread_add_method( st, "/get_error", "", get_error_handler, serv);
 	lo_server_thread_add_method( st, "/get_version", "", get_version_handler, serv);
+	lo_server_thread_add_method( st, "/get_osc_stats", "", osc_stats_handler, serv);
 	lo_server_thread_add_method( st, "/ping", "", ping_handler, serv);
+	lo_server_thread_add_method( st, "/ping", "i", ping_handler, serv);
 
 	// add method that will match any path and args
 	lo_server_thread_add_method(st, NULL, NULL, wildcard_handler, serv);
 
-	// Start the thread
+	// Start the thread (on the CPUs chosen for it)
+	rtsched_before_osc_thread();
 	lo_server_thread_start(st);
+	rtsched_after_osc_thread();
 
 	if (!quiet) {
 		char *url = lo_server_thread_get_url( st );
@@ -278,10 +911,55 @@ lo_server_thread init_osc( char *port )
 }
 
 
+lo_server_thread init_osc( char *port )
+{
+	lo_server_thread st = NULL;
+	
+	osc_reply_template( &state_reply, "/deck/state", "s" );
+	osc_reply_template( &status_reply, "/deck/status", "sfifsfs" );
+	osc_reply_template( &position_reply, "/deck/position", "f" );
+	osc_reply_template( &duration_reply, "/deck/duration", "f" );
+	osc_reply_template( &filepath_reply, "/deck/filepath", "s" );
+	osc_reply_template( &error_reply, "/error", "s" );
+	osc_reply_template( &version_reply, "/version", "ss" );
+	osc_reply_template( &osc_stats_reply, "/osc_stats", "ii" );
+	osc_reply_template( &pong_reply, "/pong", "" );
+	osc_reply_template( &pong_seq_reply, "/pong", "i" );
+	
+	st = start_server( port, LO_UDP );
+	
+	if (!st) return NULL;
+	
+	// Also listen on TCP and/or a Unix domain socket ?
+	if (osc_tcp_port && !(tcp_thread = start_server( osc_tcp_port, LO_TCP ))) {
+		fprintf(stderr, "Warning: failed to start OSC server on TCP port %s.\n", osc_tcp_port);
+	}
+	if (osc_unix_path && !(unix_thread = start_server( osc_unix_path, LO_UNIX ))) {
+		fprintf(stderr, "Warning: failed to start OSC server on socket %s.\n", osc_unix_path);
+	}
+
+	// Start sending updates to subscribers
+	init_subscribe( lo_server_thread_get_server( st ) );
+	
+	return st;
+}
+
+
 void finish_osc( lo_server_thread st )
 {
 	if (verbose) printf( "Stopping OSC server thread.\n");
 
+	finish_subscribe();
+	if (tcp_thread) {
+		lo_server_thread_stop( tcp_thread );
+		lo_server_thread_free( tcp_thread );
+		tcp_thread = NULL;
+	}
+	if (unix_thread) {
+		lo_server_thread_stop( unix_thread );
+		lo_server_thread_free( unix_thread );
+		unix_thread = NULL;
+	}
 	lo_server_thread_stop( st );
 	lo_server_thread_free( st );
 	
@@ -27,6 +27,11 @@
 #ifndef _MADJACK_OSC_H_
 #define _MADJACK_OSC_H_
 
+// Globals
+extern char *osc_tcp_port;
+extern char *osc_unix_path;
+
+
 // Prototypes
 lo_server_thread init_osc( char *port );
 void finish_osc( lo_server_thread st );
@@ -0,0 +1,200 @@
+/*
+
+	oscreply.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <lo/lo.h>
+
+#include "oscreply.h"
+#include "config.h"
+
+
+/*
+ * Replies to the common queries are serialised by hand into a buffer
+ * on the stack, starting from a copy of the path and type tags built
+ * when the server starts, and sent straight out of the server's socket.
+ * Nothing is allocated on the way.
+ *
+ * Only datagram sockets (UDP and Unix) can be sent to like this; for a
+ * TCP client, the buffer is turned back into a liblo message instead.
+ */
+
+
+// ------- Globals -------
+static unsigned long direct_replies = 0;	// Replies sent straight from the socket
+static unsigned long fallback_replies = 0;	// Replies sent through liblo
+
+
+
+// Append bytes, padded with zeros to a multiple of four
+static
+void add_padded( osc_reply_t *reply, const void* bytes, size_t len )
+{
+	size_t padded = (len + 4) & ~3;
+	
+	// Won't fit ? (the reply won't be sent)
+	if (reply->size + padded > OSC_REPLY_MAX) {
+		reply->overflow = 1;
+		return;
+	}
+	
+	memcpy( reply->data + reply->size, bytes, len );
+	memset( reply->data + reply->size + len, 0, padded - len );
+	reply->size += padded;
+}
+
+
+// Build the path and type tags for a reply, once
+void osc_reply_template( osc_reply_t *template, const char* path, const char* types )
+{
+	char typetag[64];
+	
+	snprintf( typetag, sizeof(typetag), ",%s", types );
+	template->size = 0;
+	template->overflow = 0;
+	add_padded( template, path, strlen(path) );
+	add_padded( template, typetag, strlen(typetag) );
+}
+
+
+// Start a reply from its template
+void osc_reply_begin( osc_reply_t *reply, const osc_reply_t *template )
+{
+	memcpy( reply->data, template->data, template->size );
+	reply->size = template->size;
+	reply->overflow = template->overflow;
+}
+
+
+void osc_reply_add_int32( osc_reply_t *reply, int value )
+{
+	uint32_t word = htonl( (uint32_t)value );
+	
+	if (reply->size + 4 > OSC_REPLY_MAX) {
+		reply->overflow = 1;
+		return;
+	}
+	memcpy( reply->data + reply->size, &word, 4 );
+	reply->size += 4;
+}
+
+
+void osc_reply_add_float( osc_reply_t *reply, float value )
+{
+	uint32_t word;
+	
+	memcpy( &word, &value, 4 );
+	osc_reply_add_int32( reply, (int)word );
+}
+
+
+void osc_reply_add_string( osc_reply_t *reply, const char* value )
+{
+	add_padded( reply, value, strlen( value ) );
+}
+
+
+// Work out the socket address of a datagram client
+// Returns the length of the address, or 0 if it can't be sent to directly
+static
+socklen_t address_of( lo_address dest, struct sockaddr_storage *ss )
+{
+	const char *host = lo_address_get_hostname( dest );
+	const char *port = lo_address_get_port( dest );
+	
+	memset( ss, 0, sizeof(struct sockaddr_storage) );
+	
+	if (lo_address_get_protocol( dest ) == LO_UDP && host && port) {
+		struct sockaddr_in *sin = (struct sockaddr_in*)ss;
+		struct sockaddr_in6 *sin6 = (struct sockaddr_in6*)ss;
+		
+		if (inet_pton( AF_INET, host, &sin->sin_addr ) == 1) {
+			sin->sin_family = AF_INET;
+			sin->sin_port = htons( atoi( port ) );
+			return sizeof(struct sockaddr_in);
+		} else if (inet_pton( AF_INET6, host, &sin6->sin6_addr ) == 1) {
+			sin6->sin6_family = AF_INET6;
+			sin6->sin6_port = htons( atoi( port ) );
+			return sizeof(struct sockaddr_in6);
+		}
+	} else if (lo_address_get_protocol( dest ) == LO_UNIX && port) {
+		struct sockaddr_un *sun = (struct sockaddr_un*)ss;
+		
+		if (strlen( port ) < sizeof(sun->sun_path)) {
+			sun->sun_family = AF_UNIX;
+			strcpy( sun->sun_path, port );
+			return sizeof(struct sockaddr_un);
+		}
+	}
+	
+	return 0;
+}
+
+
+// Send a reply from the server's socket
+// Returns the number of bytes sent, or less than 1 on failure
+int osc_reply_send( osc_reply_t *reply, lo_address dest, lo_server serv )
+{
+	struct sockaddr_storage ss;
+	socklen_t len = address_of( dest, &ss );
+	lo_message msg;
+	int result;
+	
+	// Arguments are missing, so it wouldn't match its type tags
+	if (reply->overflow) {
+		fprintf(stderr, "Warning: OSC reply is longer than %d bytes, not sending it.\n", OSC_REPLY_MAX);
+		return -1;
+	}
+	
+	if (len) {
+		result = sendto( lo_server_get_socket_fd( serv ), reply->data, reply->size,
+		                 0, (struct sockaddr*)&ss, len );
+		if (result >= 0) {
+			__sync_fetch_and_add( &direct_replies, 1 );
+			return result;
+		}
+	}
+	
+	// Let liblo deal with it
+	__sync_fetch_and_add( &fallback_replies, 1 );
+	msg = lo_message_deserialise( reply->data, reply->size, &result );
+	if (!msg) return -1;
+	result = lo_send_message_from( dest, serv, reply->data, msg );
+	lo_message_free( msg );
+	
+	return result;
+}
+
+
+void osc_reply_get_stats( unsigned long *direct, unsigned long *fallback )
+{
+	*direct = direct_replies;
+	*fallback = fallback_replies;
+}
+
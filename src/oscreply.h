@@ -0,0 +1,51 @@
+/*
+
+	oscreply.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include <lo/lo.h>
+
+#ifndef _OSCREPLY_H_
+#define _OSCREPLY_H_
+
+
+// Constants
+#define OSC_REPLY_MAX			(1024)		// Largest reply that can be built
+
+
+// A serialised OSC message
+typedef struct osc_reply_struct {
+	char data[OSC_REPLY_MAX];
+	size_t size;
+	int overflow;						// Set if something didn't fit
+} osc_reply_t;
+
+
+// Prototypes
+void osc_reply_template( osc_reply_t *template, const char* path, const char* types );
+void osc_reply_begin( osc_reply_t *reply, const osc_reply_t *template );
+void osc_reply_add_int32( osc_reply_t *reply, int value );
+void osc_reply_add_float( osc_reply_t *reply, float value );
+void osc_reply_add_string( osc_reply_t *reply, const char* value );
+int osc_reply_send( osc_reply_t *reply, lo_address dest, lo_server serv );
+void osc_reply_get_stats( unsigned long *direct, unsigned long *fallback );
+
+#endif
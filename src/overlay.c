@@ -0,0 +1,220 @@
+/*
+
+	overlay.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "madjack.h"
+#include "overlay.h"
+#include "config.h"
+
+
+/*
+ * The overlay is a buffer of decoded audio that the JACK callback
+ * plays before going back to the ringbuffer. It lets playback start
+ * straight away from memory, while the decoder thread is restarted
+ * from the point where the overlay ends.
+ *
+ * When the deck is already playing, the start of the overlay is
+ * crossfaded with the audio that was in the ringbuffer, so that
+ * jumping to a new position doesn't click.
+ */
+
+
+// ------- Globals -------
+static pcm_buffer_t *overlay_pcm = NULL;		// Audio to play before the ringbuffer
+static unsigned int overlay_position = 0;		// Read position in the overlay (in frames)
+static int overlay_active = 0;				// Set while the callback is playing the overlay
+static unsigned int overlay_start = 0;			// Position that playback starts from
+static unsigned int overlay_fade = 0;			// Frames to crossfade from the ringbuffer
+static int overlay_sync = 0;					// Set to line up the start with a transport frame
+static jack_nframes_t overlay_sync_frame = 0;	// Transport frame the start should play at
+
+
+
+// Set up the overlay, then hand it to the callback
+static
+void setup_overlay( pcm_buffer_t *pcm, unsigned int offset, unsigned int fade,
+                    int sync, jack_nframes_t sync_frame )
+{
+	overlay_active = 0;
+	__sync_synchronize();
+	
+	if (offset > pcm->length) offset = pcm->length;
+	overlay_pcm = pcm;
+	overlay_start = offset;
+	overlay_position = offset;
+	overlay_fade = fade;
+	if (overlay_fade > pcm->length - offset) overlay_fade = pcm->length - offset;
+	overlay_sync_frame = sync_frame;
+	overlay_sync = sync;
+	
+	__sync_synchronize();
+	overlay_active = (pcm->length > offset);
+}
+
+
+// Make the callback play a buffer next, starting 'offset' frames in
+// (crossfading from the ringbuffer over 'fade' frames)
+void start_overlay( pcm_buffer_t *pcm, unsigned int offset, unsigned int fade )
+{
+	setup_overlay( pcm, offset, fade, 0, 0 );
+}
+
+
+// Start playing a buffer, so that the frame at 'offset' lines up with
+// JACK transport frame 'sync_frame' (skipping any that are already late)
+void start_overlay_synced( pcm_buffer_t *pcm, unsigned int offset, unsigned int fade,
+                           jack_nframes_t sync_frame )
+{
+	setup_overlay( pcm, offset, fade, 1, sync_frame );
+}
+
+
+// Called by the JACK callback with the transport frame of this period
+void sync_overlay( jack_nframes_t frame )
+{
+	unsigned int late;
+
+	if (!overlay_active || !overlay_sync) return;
+	overlay_sync = 0;
+	
+	if (frame <= overlay_sync_frame) return;
+	late = frame - overlay_sync_frame;
+	if (late > overlay_pcm->length - overlay_position)
+		late = overlay_pcm->length - overlay_position;
+	
+	overlay_position += late;
+	overlay_start = overlay_position;
+	if (overlay_fade > overlay_pcm->length - overlay_position)
+		overlay_fade = overlay_pcm->length - overlay_position;
+}
+
+
+void stop_overlay()
+{
+	overlay_active = 0;
+}
+
+
+// Wait until the callback has started playing the overlay
+// and finished crossfading (so it is no longer reading the ringbuffer)
+// Doesn't give up after a while: emptying the ringbuffer while the
+// callback is still fading out of it would be heard. It only stops
+// early if the deck stops playing (e.g. JACK shut down).
+void wait_for_overlay_start()
+{
+	while (overlay_active && get_state() == MADJACK_STATE_PLAYING &&
+	       (overlay_position == overlay_start ||
+	        overlay_position - overlay_start < overlay_fade)) {
+		usleep(1000);
+	}
+}
+
+
+int overlay_is_active()
+{
+	return overlay_active;
+}
+
+
+// Returns true while the start of the overlay is still
+// being crossfaded with the ringbuffer
+int overlay_is_crossfading()
+{
+	return overlay_active && overlay_position - overlay_start < overlay_fade;
+}
+
+
+// Returns true if a buffer is being played by the callback
+int overlay_is_using( pcm_buffer_t *pcm )
+{
+	return overlay_active && overlay_pcm == pcm;
+}
+
+
+/*
+ * Mix old audio from the ringbuffer into the start of a buffer,
+ * fading it out, while fading in the audio already in the buffer.
+ * 'pos' is how far into the crossfade the buffer starts.
+ */
+
+void crossfade_from_ringbuffer( unsigned int channel, float* buffer, unsigned int nframes,
+                                unsigned int pos, unsigned int fade )
+{
+	unsigned int done = 0;
+	unsigned int i;
+
+	while (pos < fade && done < nframes) {
+		float old[OVERLAY_FADE_CHUNK];
+		unsigned int len = fade - pos;
+		unsigned int got;
+		
+		if (len > nframes - done) len = nframes - done;
+		if (len > OVERLAY_FADE_CHUNK) len = OVERLAY_FADE_CHUNK;
+		
+		got = jack_ringbuffer_read( ringbuffer[channel], (char*)old, len * sizeof(float) ) / sizeof(float);
+		if (got < len) bzero( old + got, (len - got) * sizeof(float) );
+		
+		// Equal power crossfade
+		for (i=0; i<len; i++) {
+			float t = (float)(pos + i) / fade;
+			buffer[done+i] = buffer[done+i] * sqrtf( t ) + old[i] * sqrtf( 1.0f - t );
+		}
+		
+		pos += len;
+		done += len;
+	}
+}
+
+
+// Copy audio for one channel from the overlay into a JACK buffer
+// Returns the number of frames copied
+unsigned int read_overlay( unsigned int channel, float* buffer, unsigned int nframes )
+{
+	unsigned int avail = overlay_pcm->length - overlay_position;
+
+	if (nframes > avail) nframes = avail;
+	memcpy( buffer, overlay_pcm->samples[channel] + overlay_position, nframes * sizeof(float) );
+	
+	// Mix in the old audio from the ringbuffer, fading it out
+	if (overlay_position - overlay_start < overlay_fade) {
+		crossfade_from_ringbuffer( channel, buffer, nframes,
+		                           overlay_position - overlay_start, overlay_fade );
+	}
+	
+	return nframes;
+}
+
+
+// Move playback position on, once all channels have been read
+void advance_overlay( unsigned int nframes )
+{
+	overlay_position += nframes;
+	if (overlay_position >= overlay_pcm->length) {
+		overlay_active = 0;
+	}
+}
+
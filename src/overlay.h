@@ -0,0 +1,50 @@
+/*
+
+	overlay.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "madjack.h"
+
+#ifndef _OVERLAY_H_
+#define _OVERLAY_H_
+
+
+// Constants
+#define OVERLAY_CROSSFADE_LEN	(0.01)		// Crossfade into overlay (in seconds)
+#define OVERLAY_FADE_CHUNK		(256)		// Frames of old audio mixed at once
+
+
+// Prototypes
+void start_overlay( pcm_buffer_t *pcm, unsigned int offset, unsigned int fade );
+void start_overlay_synced( pcm_buffer_t *pcm, unsigned int offset, unsigned int fade,
+                           jack_nframes_t sync_frame );
+void sync_overlay( jack_nframes_t frame );
+void stop_overlay();
+void wait_for_overlay_start();
+int overlay_is_active();
+int overlay_is_crossfading();
+int overlay_is_using( pcm_buffer_t *pcm );
+void crossfade_from_ringbuffer( unsigned int channel, float* buffer, unsigned int nframes,
+                                unsigned int pos, unsigned int fade );
+unsigned int read_overlay( unsigned int channel, float* buffer, unsigned int nframes );
+void advance_overlay( unsigned int nframes );
+
+#endif
@@ -0,0 +1,78 @@
+/*
+
+	pcmbuffer.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "madjack.h"
+#include "pcmbuffer.h"
+#include "rtmem.h"
+#include "config.h"
+
+
+
+// Create a buffer that can hold 'capacity' frames of stereo audio
+pcm_buffer_t* init_pcm_buffer( unsigned int capacity )
+{
+	pcm_buffer_t* pcm;
+	int c;
+	
+	// Allocate memory for data structure
+	pcm = malloc( sizeof( pcm_buffer_t ) );
+	if (pcm == NULL) {
+		fprintf(stderr, "Failed to allocate memory for PCM buffer record.\n");
+		exit(1);
+	}
+	bzero( pcm, sizeof( pcm_buffer_t ) );
+	
+	// Allocate memory for the samples
+	pcm->capacity = capacity;
+	for (c=0; c<2; c++) {
+		pcm->samples[c] = rtmem_malloc( capacity * sizeof(float), &pcm->locked );
+		if (pcm->samples[c] == NULL) {
+			fprintf(stderr, "Failed to allocate memory for PCM buffer.\n");
+			exit(1);
+		}
+	}
+	
+	return pcm;
+}
+
+
+void finish_pcm_buffer( pcm_buffer_t* pcm )
+{
+	if (pcm == NULL) return;
+	
+	rtmem_free( pcm->samples[0], pcm->capacity * sizeof(float), pcm->locked );
+	rtmem_free( pcm->samples[1], pcm->capacity * sizeof(float), pcm->locked );
+	free( pcm );
+}
+
+
+// Number of bytes of memory used by a PCM buffer
+unsigned long pcm_buffer_bytes( pcm_buffer_t* pcm )
+{
+	if (pcm == NULL) return 0;
+	return (unsigned long)pcm->capacity * 2 * sizeof(float);
+}
+
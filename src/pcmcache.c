@@ -0,0 +1,443 @@
+/*
+
+	pcmcache.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+
+#include <pthread.h>
+#include <jack/jack.h>
+
+#include "madjack.h"
+#include "pcmcache.h"
+#include "config.h"
+
+
+/*
+ * Decoded carts are shared between all the MadJACK processes on a host.
+ * Each decoded track lives in its own POSIX shared memory segment, which
+ * is mapped read-only by the processes playing it. A small shared index
+ * keeps track of the segments, so that the least recently used ones can
+ * be unlinked when the cache goes over budget. Processes that still have
+ * an evicted track mapped can carry on playing it.
+ */
+
+
+// ------- Globals -------
+float pcmcache_budget = 0.0f;			// Size of the shared cache (in megabytes)
+
+static pcmcache_index_t *pcmcache = NULL;	// Mapping of the shared index
+
+
+
+static
+void lock_index()
+{
+	int result = pthread_mutex_lock( &pcmcache->lock );
+	
+#ifdef HAVE_PTHREAD_MUTEXATTR_SETROBUST
+	// Another process died while holding the lock
+	if (result == EOWNERDEAD) {
+		fprintf(stderr, "Warning: recovering PCM cache lock from dead process.\n");
+		pthread_mutex_consistent( &pcmcache->lock );
+		result = 0;
+	}
+#endif
+
+	if (result) {
+		fprintf(stderr, "Error: failed to lock PCM cache: %s\n", strerror(result));
+		exit(-1);
+	}
+}
+
+
+static
+void unlock_index()
+{
+	pthread_mutex_unlock( &pcmcache->lock );
+}
+
+
+static
+void segment_name( char* name, size_t len, unsigned int segment )
+{
+	snprintf( name, len, PCMCACHE_SEGMENT_NAME, segment );
+}
+
+
+static
+int entry_matches( pcmcache_entry_t *entry, struct stat *st )
+{
+	return entry->dev == st->st_dev && entry->ino == st->st_ino &&
+	       entry->size == st->st_size && entry->mtime == st->st_mtime;
+}
+
+
+// Remove an entry from the cache (index must be locked)
+static
+void evict_entry( pcmcache_entry_t *entry )
+{
+	char name[32];
+	
+	segment_name( name, sizeof(name), entry->segment );
+	shm_unlink( name );
+	
+	pcmcache->used -= entry->bytes;
+	bzero( entry, sizeof(pcmcache_entry_t) );
+}
+
+
+// Free entries left half-written by processes that have gone away
+// (index must be locked)
+static
+void reap_dead_writers()
+{
+	int i;
+	
+	for (i=0; i<PCMCACHE_MAX_ENTRIES; i++) {
+		pcmcache_entry_t *entry = &pcmcache->entries[i];
+		if (entry->ready == -1 && kill( entry->writer, 0 ) && errno == ESRCH) {
+			evict_entry( entry );
+		}
+	}
+}
+
+
+// Evict least recently used entries until there is room for 'bytes'
+// (index must be locked)
+static
+int make_room( unsigned long bytes )
+{
+	// Would never fit, so don't throw everything else out trying
+	if (bytes > pcmcache->budget) return 0;
+	
+	while (pcmcache->used + bytes > pcmcache->budget) {
+		pcmcache_entry_t *oldest = NULL;
+		int i;
+		
+		for (i=0; i<PCMCACHE_MAX_ENTRIES; i++) {
+			pcmcache_entry_t *entry = &pcmcache->entries[i];
+			if (entry->ready != 1) continue;
+			if (oldest == NULL || entry->last_used < oldest->last_used)
+				oldest = entry;
+		}
+		
+		// Nothing left to evict ?
+		if (oldest == NULL) return 0;
+		
+		if (verbose) printf("Evicting segment %u from PCM cache.\n", oldest->segment);
+		evict_entry( oldest );
+		pcmcache->evictions++;
+	}
+	
+	return 1;
+}
+
+
+// Count a lookup that found an entry, but couldn't map it
+static
+void count_miss()
+{
+	lock_index();
+	pcmcache->misses++;
+	unlock_index();
+}
+
+
+/*
+ * Look for a decoded copy of a file in the shared cache.
+ * If found, it is mapped read-only and 'view' points into the mapping.
+ *
+ * Returns 1 on a hit, 0 on a miss.
+ */
+
+int pcmcache_lookup( struct stat *st, pcm_buffer_t *view )
+{
+	unsigned int samplerate = jack_get_sample_rate( client );
+	pcmcache_entry_t found;
+	char name[32];
+	void* mapping;
+	int fd, i;
+
+	if (pcmcache == NULL) return 0;
+	bzero( &found, sizeof(found) );
+
+	lock_index();
+	for (i=0; i<PCMCACHE_MAX_ENTRIES; i++) {
+		pcmcache_entry_t *entry = &pcmcache->entries[i];
+		if (entry->ready == 1 && entry_matches( entry, st ) &&
+		    entry->samplerate == samplerate)
+		{
+			entry->last_used = ++pcmcache->clock;
+			found = *entry;
+			break;
+		}
+	}
+	
+	if (!found.ready) pcmcache->misses++;
+	unlock_index();
+	
+	if (!found.ready) return 0;
+
+
+	// Map the segment
+	segment_name( name, sizeof(name), found.segment );
+	fd = shm_open( name, O_RDONLY, 0 );
+	if (fd < 0) {
+		// Evicted since we looked
+		if (verbose) printf("PCM cache segment %s has gone away.\n", name);
+		count_miss();
+		return 0;
+	}
+	
+	mapping = mmap( NULL, found.bytes, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if (mapping == MAP_FAILED) {
+		fprintf(stderr, "Warning: failed to map PCM cache segment: %s\n", strerror(errno));
+		count_miss();
+		return 0;
+	}
+	
+	lock_index();
+	pcmcache->hits++;
+	unlock_index();
+	
+	// Channels are stored one after the other
+	view->samples[0] = (float*)mapping;
+	view->samples[1] = (float*)mapping + found.frames;
+	view->length = found.frames;
+	view->capacity = found.frames;
+
+	if (verbose) printf("Found track in PCM cache (segment %u).\n", found.segment);
+
+	return 1;
+}
+
+
+// Unmap a view returned by pcmcache_lookup()
+void pcmcache_release( pcm_buffer_t *view )
+{
+	if (view->samples[0]) {
+		munmap( view->samples[0], (size_t)view->capacity * 2 * sizeof(float) );
+	}
+	bzero( view, sizeof(pcm_buffer_t) );
+}
+
+
+// Add a decoded track to the shared cache
+void pcmcache_store( struct stat *st, pcm_buffer_t *pcm )
+{
+	unsigned long bytes = (unsigned long)pcm->length * 2 * sizeof(float);
+	pcmcache_entry_t *entry = NULL;
+	unsigned int segment;
+	char name[32];
+	float* mapping;
+	int fd, i;
+
+	if (pcmcache == NULL || bytes == 0) return;
+	
+	lock_index();
+	reap_dead_writers();
+	
+	// Somebody else got there first ? (at the same sample rate)
+	for (i=0; i<PCMCACHE_MAX_ENTRIES; i++) {
+		if (pcmcache->entries[i].ready && entry_matches( &pcmcache->entries[i], st ) &&
+		    pcmcache->entries[i].samplerate == jack_get_sample_rate( client ))
+		{
+			unlock_index();
+			return;
+		}
+	}
+	
+	// Find a free entry, with enough room in the budget
+	if (make_room( bytes )) {
+		for (i=0; i<PCMCACHE_MAX_ENTRIES; i++) {
+			if (pcmcache->entries[i].ready == 0) {
+				entry = &pcmcache->entries[i];
+				break;
+			}
+		}
+	}
+	
+	if (entry == NULL) {
+		if (verbose) printf("No room in PCM cache for track.\n");
+		unlock_index();
+		return;
+	}
+	
+	// Reserve the entry while we fill the segment
+	segment = pcmcache->next_segment++;
+	entry->ready = -1;
+	entry->writer = getpid();
+	entry->segment = segment;
+	entry->dev = st->st_dev;
+	entry->ino = st->st_ino;
+	entry->size = st->st_size;
+	entry->mtime = st->st_mtime;
+	entry->samplerate = jack_get_sample_rate( client );
+	entry->frames = pcm->length;
+	entry->bytes = bytes;
+	entry->last_used = ++pcmcache->clock;
+	pcmcache->used += bytes;
+	unlock_index();
+	
+	
+	// Create and fill the segment
+	segment_name( name, sizeof(name), segment );
+	fd = shm_open( name, O_RDWR|O_CREAT|O_EXCL, 0644 );
+	if (fd < 0 || ftruncate( fd, bytes )) {
+		fprintf(stderr, "Warning: failed to create PCM cache segment: %s\n", strerror(errno));
+		if (fd >= 0) close( fd );
+		lock_index();
+		evict_entry( entry );
+		unlock_index();
+		return;
+	}
+	
+	mapping = mmap( NULL, bytes, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	if (mapping == MAP_FAILED) {
+		fprintf(stderr, "Warning: failed to map PCM cache segment: %s\n", strerror(errno));
+		lock_index();
+		evict_entry( entry );
+		unlock_index();
+		return;
+	}
+	
+	memcpy( mapping, pcm->samples[0], pcm->length * sizeof(float) );
+	memcpy( mapping + pcm->length, pcm->samples[1], pcm->length * sizeof(float) );
+	munmap( mapping, bytes );
+	
+	// Now other processes can use it
+	lock_index();
+	entry->ready = 1;
+	unlock_index();
+	
+	if (verbose) printf("Stored track in PCM cache (segment %u, %lu bytes).\n", segment, bytes);
+}
+
+
+void pcmcache_get_stats( unsigned long *hits, unsigned long *misses, unsigned long *evictions,
+                         unsigned long long *used, unsigned long long *budget )
+{
+	*hits = *misses = *evictions = 0;
+	*used = *budget = 0;
+	if (pcmcache == NULL) return;
+	
+	lock_index();
+	*hits = pcmcache->hits;
+	*misses = pcmcache->misses;
+	*evictions = pcmcache->evictions;
+	*used = pcmcache->used;
+	*budget = pcmcache->budget;
+	unlock_index();
+}
+
+
+// Initialise the lock and counters of a newly created index
+static
+void create_index()
+{
+	pthread_mutexattr_t attr;
+	
+	pthread_mutexattr_init( &attr );
+	pthread_mutexattr_setpshared( &attr, PTHREAD_PROCESS_SHARED );
+#ifdef HAVE_PTHREAD_MUTEXATTR_SETROBUST
+	pthread_mutexattr_setrobust( &attr, PTHREAD_MUTEX_ROBUST );
+#endif
+	pthread_mutex_init( &pcmcache->lock, &attr );
+	pthread_mutexattr_destroy( &attr );
+	
+	pcmcache->budget = pcmcache_budget * 1024 * 1024;
+	pcmcache->version = PCMCACHE_VERSION;
+	
+	// Mark as ready last
+	__sync_synchronize();
+	pcmcache->magic = PCMCACHE_MAGIC;
+}
+
+
+void init_pcmcache()
+{
+	int created = 0;
+	int fd, i;
+	
+	// Shared cache disabled ?
+	if (pcmcache_budget <= 0.0f) return;
+	
+	// Create the index, or open an existing one
+	fd = shm_open( PCMCACHE_INDEX_NAME, O_RDWR|O_CREAT|O_EXCL, 0644 );
+	if (fd >= 0) {
+		created = 1;
+		if (ftruncate( fd, sizeof(pcmcache_index_t) )) {
+			perror("failed to resize PCM cache index");
+			exit(1);
+		}
+	} else if (errno == EEXIST) {
+		fd = shm_open( PCMCACHE_INDEX_NAME, O_RDWR, 0 );
+	}
+	
+	if (fd < 0) {
+		perror("failed to open PCM cache index");
+		exit(1);
+	}
+	
+	pcmcache = mmap( NULL, sizeof(pcmcache_index_t), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	if (pcmcache == MAP_FAILED) {
+		perror("failed to map PCM cache index");
+		exit(1);
+	}
+	
+	if (created) {
+		create_index();
+	} else {
+		// Wait for the creator to finish setting it up
+		for (i=0; i<1000 && pcmcache->magic != PCMCACHE_MAGIC; i++)
+			usleep(1000);
+		
+		if (pcmcache->magic != PCMCACHE_MAGIC || pcmcache->version != PCMCACHE_VERSION) {
+			fprintf(stderr, "PCM cache index %s is not compatible.\n", PCMCACHE_INDEX_NAME);
+			exit(1);
+		}
+	}
+	
+	if (!quiet) printf("Shared PCM cache budget is %llu bytes (%llu bytes in use).\n",
+	                   pcmcache->budget, pcmcache->used );
+}
+
+
+void finish_pcmcache()
+{
+	if (pcmcache) {
+		munmap( pcmcache, sizeof(pcmcache_index_t) );
+		pcmcache = NULL;
+	}
+}
+
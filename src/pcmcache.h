@@ -0,0 +1,91 @@
+/*
+
+	pcmcache.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "madjack.h"
+
+#ifndef _PCMCACHE_H_
+#define _PCMCACHE_H_
+
+
+// Constants
+#define PCMCACHE_INDEX_NAME		"/madjack-pcmcache"
+#define PCMCACHE_SEGMENT_NAME	"/madjack-pcm-%u"
+#define PCMCACHE_MAX_ENTRIES	(1024)
+#define PCMCACHE_MAGIC			(0x4d4a5043)		// 'MJPC'
+#define PCMCACHE_VERSION		(1)
+
+
+// A single decoded track, stored in its own shared memory segment
+typedef struct pcmcache_entry_struct {
+	int ready;							// 1=populated, -1=being written, 0=unused
+	pid_t writer;						// Process populating the entry
+	unsigned int segment;				// Number used in segment name
+	
+	dev_t dev;							// Identity of the source file
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+	
+	unsigned int samplerate;			// Sample rate of decoded audio
+	unsigned int frames;				// Number of frames of audio
+	unsigned long bytes;				// Size of the segment
+	unsigned long long last_used;		// For least-recently-used eviction
+} pcmcache_entry_t;
+
+
+// Index shared by all MadJACK processes on the host
+typedef struct pcmcache_index_struct {
+	unsigned int magic;
+	unsigned int version;
+	pthread_mutex_t lock;				// Process-shared lock for the index
+	
+	unsigned long long budget;			// Maximum bytes of decoded audio
+	unsigned long long used;			// Bytes of decoded audio in the cache
+	unsigned long long clock;			// Incremented on every access
+	unsigned int next_segment;
+	
+	unsigned long hits;					// Statistics for all processes
+	unsigned long misses;
+	unsigned long evictions;
+	
+	pcmcache_entry_t entries[PCMCACHE_MAX_ENTRIES];
+} pcmcache_index_t;
+
+
+// Globals
+extern float pcmcache_budget;
+
+
+// Prototypes
+void init_pcmcache();
+void finish_pcmcache();
+int pcmcache_lookup( struct stat *st, pcm_buffer_t *view );
+void pcmcache_release( pcm_buffer_t *view );
+void pcmcache_store( struct stat *st, pcm_buffer_t *pcm );
+void pcmcache_get_stats( unsigned long *hits, unsigned long *misses, unsigned long *evictions,
+                         unsigned long long *used, unsigned long long *budget );
+
+#endif
@@ -0,0 +1,635 @@
+/*
+
+	playlist.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <jack/jack.h>
+#include <jack/ringbuffer.h>
+
+#include "madjack.h"
+#include "control.h"
+#include "command.h"
+#include "maddecode.h"
+#include "pcmbuffer.h"
+#include "preload.h"
+#include "overlay.h"
+#include "cart.h"
+#include "loop.h"
+#include "hotcue.h"
+#include "status.h"
+#include "playlist.h"
+#include "config.h"
+
+
+/*
+ * Tracks can be queued up in the deck, to be played one after another
+ * without a client having to load each one when the last one ends.
+ *
+ * The playlist thread opens the track at the head of the queue while
+ * the current one is playing, and decodes its start into memory. When
+ * the current track runs out, the JACK callback carries straight on
+ * into that pre-roll in the same period, so there is no gap. If a
+ * crossfade has been set, the pre-roll is instead started as an
+ * overlay that far before the end, fading out the old track from the
+ * ringbuffer.
+ *
+ * Either way, the control worker then swaps the new track into
+ * input_file and restarts the decoder from the end of the pre-roll,
+ * in the same way as a seek. If the next track couldn't be prepared,
+ * it is loaded and played in the usual way once the deck stops at the
+ * end of the current one.
+ */
+
+
+// How far the next track has got
+enum playlist_stage {
+	STAGE_EMPTY,			// Nothing prepared
+	STAGE_FAILED,			// Head of the queue couldn't be prepared
+	STAGE_READY,			// Opened and pre-rolled, waiting for the end of the track
+	STAGE_FADE_PENDING,		// Control worker has been asked to start the crossfade
+	STAGE_FADING,			// Crossfading into the pre-roll
+	STAGE_STARTED,			// Playing the pre-roll
+	STAGE_ADVANCING			// Control worker has been asked to swap the tracks over
+};
+
+
+// A track in the queue
+typedef struct playlist_item_struct {
+	char *path;							// File path, relative to the root directory
+	unsigned long id;					// Identifies it, wherever it moves to
+} playlist_item_t;
+
+
+// ------- Globals -------
+static playlist_item_t items[PLAYLIST_MAX];		// Tracks waiting to be played
+static unsigned int item_count = 0;
+static unsigned long next_id = 1;				// Id for the next track added
+static unsigned int generation = 0;				// Changed whenever the head of the queue changes
+static pthread_mutex_t playlist_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static float crossfade = 0.0f;					// Seconds to crossfade (0 for gapless)
+
+static volatile int next_stage = STAGE_EMPTY;
+static unsigned int next_generation = 0;		// Generation the next track was prepared for
+static unsigned long next_item = 0;				// Id of the queued track that was prepared
+static input_file_t next_input;					// Next track (with no read buffer of its own)
+static pcm_buffer_t *preroll = NULL;			// Decoded start of the next track
+static int preroll_at_eof = 0;					// Set if the whole track is in the pre-roll
+
+static pthread_t playlist_thread;				// Thread that prepares the next track
+static int playlist_running = 0;				// Cleared to stop the thread
+static int load_pending = 0;					// Set once the next track has been asked for
+static jack_nframes_t rate = 0;					// JACK's sample rate
+
+
+
+// Add a track to the end of the queue
+// Returns 0 on success
+int playlist_add( const char* path )
+{
+	return playlist_insert( PLAYLIST_MAX, path );
+}
+
+
+// Insert a track before position 'index' (0 for the next one to play)
+// Returns 0 on success
+int playlist_insert( unsigned int index, const char* path )
+{
+	char *item = strdup( path );
+	int result = 0;
+	
+	if (!item) return -1;
+	
+	pthread_mutex_lock( &playlist_lock );
+	if (item_count < PLAYLIST_MAX) {
+		if (index > item_count) index = item_count;
+		memmove( &items[index+1], &items[index], (item_count - index) * sizeof(playlist_item_t) );
+		items[index].path = item;
+		items[index].id = next_id++;
+		item_count++;
+		if (index == 0) generation++;
+	} else {
+		result = -1;
+	}
+	pthread_mutex_unlock( &playlist_lock );
+	
+	if (result) {
+		fprintf(stderr, "Warning: can't queue more than %d tracks.\n", PLAYLIST_MAX);
+		free( item );
+	}
+	
+	return result;
+}
+
+
+// Take the track at 'index' out of the queue (playlist must be locked)
+// Returns its path, to be freed by the caller
+static
+char* remove_item( unsigned int index )
+{
+	char *item = items[index].path;
+	
+	item_count--;
+	memmove( &items[index], &items[index+1], (item_count - index) * sizeof(playlist_item_t) );
+	if (index == 0) generation++;
+	
+	return item;
+}
+
+
+// Remove the track at position 'index'
+// Returns 0 on success
+int playlist_remove( unsigned int index )
+{
+	char *item = NULL;
+	
+	pthread_mutex_lock( &playlist_lock );
+	if (index < item_count) item = remove_item( index );
+	pthread_mutex_unlock( &playlist_lock );
+	
+	if (!item) {
+		fprintf(stderr, "Warning: there is no track %u in the queue.\n", index);
+		return -1;
+	}
+	
+	free( item );
+	return 0;
+}
+
+
+void playlist_clear()
+{
+	pthread_mutex_lock( &playlist_lock );
+	while (item_count) free( items[--item_count].path );
+	generation++;
+	pthread_mutex_unlock( &playlist_lock );
+}
+
+
+// Take a copy of the queue, to be freed by the caller
+// (each path, then the array)
+char** playlist_copy( unsigned int *count )
+{
+	char **copy;
+	unsigned int i;
+	
+	pthread_mutex_lock( &playlist_lock );
+	copy = calloc( item_count + 1, sizeof(char*) );
+	*count = 0;
+	for (i=0; copy && i<item_count; i++) {
+		if ((copy[i] = strdup( items[i].path ))) *count = i + 1;
+		else break;
+	}
+	pthread_mutex_unlock( &playlist_lock );
+	
+	return copy;
+}
+
+
+// Set the length of the crossfade between tracks (0 for gapless)
+void playlist_set_crossfade( float seconds )
+{
+	if (isnan( seconds )) {
+		fprintf(stderr, "Warning: crossfade isn't a number, ignoring it.\n");
+		return;
+	}
+	
+	if (seconds < 0.0f) seconds = 0.0f;
+	if (seconds > PLAYLIST_MAX_CROSSFADE) {
+		fprintf(stderr, "Warning: crossfade can't be longer than %2.0f seconds.\n", PLAYLIST_MAX_CROSSFADE);
+		seconds = PLAYLIST_MAX_CROSSFADE;
+	}
+	
+	// The pre-roll needs to be long enough to cover it
+	pthread_mutex_lock( &playlist_lock );
+	crossfade = seconds;
+	generation++;
+	pthread_mutex_unlock( &playlist_lock );
+}
+
+
+float playlist_get_crossfade()
+{
+	return crossfade;
+}
+
+
+// Take a track that has started playing off the queue
+// (wherever it has been moved to since, if it is still there at all)
+static
+void pop_item( unsigned long id )
+{
+	char *item = NULL;
+	unsigned int i;
+	
+	pthread_mutex_lock( &playlist_lock );
+	for (i=0; i<item_count; i++) {
+		if (items[i].id == id) {
+			item = remove_item( i );
+			break;
+		}
+	}
+	pthread_mutex_unlock( &playlist_lock );
+	
+	free( item );
+}
+
+
+// Close the next track (once nothing else can be using it)
+static
+void close_next()
+{
+	if (next_input.file) fclose( next_input.file );
+	free_preload( &next_input );
+	free( next_input.filepath );
+	free( next_input.fullpath );
+	bzero( &next_input, sizeof(input_file_t) );
+}
+
+
+// Open the next track and decode the start of it
+// Returns 0 on success, -2 if it can't be played at JACK's sample rate
+static
+int prepare_next( const char* path )
+{
+	unsigned long long frames = (unsigned long long)((crossfade + PLAYLIST_PREROLL) * rate);
+	unsigned int capacity;
+	
+	// (in whole MPEG audio frames, so that the decoder can carry on after it)
+	frames = SAMPLES_PER_FRAME * (frames / SAMPLES_PER_FRAME + 1);
+	if (frames > UINT_MAX) {
+		fprintf(stderr, "Warning: pre-roll of %llu frames is too long.\n", frames);
+		return -1;
+	}
+	capacity = frames;
+	
+	// Don't overwrite the buffer while it is being played
+	while (playlist_running && overlay_is_using( preroll )) usleep(1000);
+	if (preroll && preroll->capacity < capacity) {
+		finish_pcm_buffer( preroll );
+		preroll = NULL;
+	}
+	if (preroll == NULL) preroll = init_pcm_buffer( capacity );
+	if (preroll == NULL) return -1;
+	
+	close_next();
+	next_input.filepath = strdup( path );
+	next_input.fullpath = build_fullpath( root_directory, path );
+	if (verbose) printf("Preparing next track: %s\n", next_input.fullpath);
+	
+	next_input.file = fopen( next_input.fullpath, "r" );
+	if (next_input.file == NULL) {
+		fprintf(stderr, "Warning: failed to open next track: %s\n", next_input.fullpath);
+		close_next();
+		return -1;
+	}
+	fstat( fileno( next_input.file ), &next_input.file_stat );
+	
+	// Short enough to be a cart ? Leave it to be loaded the usual way,
+	// so that it is decoded into memory (or found in the PCM cache)
+	mpeg_audio_length( &next_input );
+	if (cart_duration > 0.0f &&
+	    next_input.end_pos - next_input.start_pos <= cart_duration * CART_BYTES_PER_SEC)
+	{
+		if (verbose) printf("Next track will be loaded as a cart: %s\n", next_input.fullpath);
+		close_next();
+		return -1;
+	}
+	
+	// Read the whole file into memory, as do_load() would
+	if (preload) {
+		int err = preload_input_file( &next_input );
+		if (err) {
+			fprintf(stderr, "Warning: failed to preload next track: %s: %s\n", strerror( err ), next_input.fullpath);
+			close_next();
+			return -1;
+		}
+	}
+	
+	// Decode the start of it
+	if (decode_to_buffer( &next_input, next_input.file, 0, preroll, &preroll_at_eof ) <= 0 ||
+	    next_input.samplerate != rate)
+	{
+		if (next_input.samplerate && next_input.samplerate != rate) {
+			fprintf(stderr, "Warning: skipping next track, because its sample rate is not %u Hz: %s\n",
+			        rate, next_input.fullpath);
+			close_next();
+			return -2;
+		}
+		fprintf(stderr, "Warning: failed to decode next track: %s\n", next_input.fullpath);
+		close_next();
+		return -1;
+	}
+	
+	return 0;
+}
+
+
+// Can the next track take over from the ringbuffer ?
+static
+int can_take_over()
+{
+	return !cart_is_loaded() && !loop_is_active() && !overlay_is_active();
+}
+
+
+/*
+ * Called by the JACK callback at the start of each period. If the
+ * current track will run out during it, and the next one is ready,
+ * returns the pre-roll to carry on with once the ringbuffer is empty.
+ */
+
+pcm_buffer_t* playlist_splice( jack_nframes_t nframes )
+{
+	if (next_stage != STAGE_READY) return NULL;
+	if (get_state() != MADJACK_STATE_PLAYING || is_decoding || !can_take_over()) return NULL;
+	if (jack_ringbuffer_read_space( ringbuffer[0] ) >= nframes * sizeof(float)) return NULL;
+	
+	if (!__sync_bool_compare_and_swap( &next_stage, STAGE_READY, STAGE_STARTED )) return NULL;
+	
+	return preroll;
+}
+
+
+// Called by the JACK callback once it has played the first
+// 'offset' frames of the pre-roll, to play the rest as an overlay
+void playlist_spliced( pcm_buffer_t *pcm, unsigned int offset )
+{
+	start_overlay( pcm, offset, 0 );
+}
+
+
+// Start crossfading into the next track (run by the control worker)
+void playlist_crossfade()
+{
+	float remaining = input_file->duration - input_file->position;
+	
+	if (!__sync_bool_compare_and_swap( &next_stage, STAGE_FADE_PENDING, STAGE_FADING )) return;
+	if (verbose) printf("-> playlist_crossfade(%s)\n", next_input.filepath);
+	
+	// Stopped, or something else is being played from memory
+	if (get_state() != MADJACK_STATE_PLAYING || !can_take_over()) {
+		next_stage = STAGE_READY;
+		return;
+	}
+	
+	if (remaining > crossfade) remaining = crossfade;
+	if (remaining < 0.0f) remaining = 0.0f;
+	
+	start_overlay( preroll, 0, remaining * rate );
+	input_file->position = 0.0f;
+}
+
+
+/*
+ * Called by the control worker before the deck is cued, seeked, looped
+ * or ejected. Any change to the next track that has started is called
+ * off, and the pre-roll is kept for the end of the track again.
+ */
+
+void playlist_cancel()
+{
+	if (__sync_bool_compare_and_swap( &next_stage, STAGE_FADE_PENDING, STAGE_READY ) ||
+	    __sync_bool_compare_and_swap( &next_stage, STAGE_FADING, STAGE_READY ) ||
+	    __sync_bool_compare_and_swap( &next_stage, STAGE_STARTED, STAGE_READY ) ||
+	    __sync_bool_compare_and_swap( &next_stage, STAGE_ADVANCING, STAGE_READY ))
+	{
+		if (verbose) printf("Cancelled change to next track: %s\n", next_input.filepath);
+		if (overlay_is_using( preroll )) stop_overlay();
+	}
+}
+
+
+// Swap the next track into the deck, once it has started playing
+// (run by the control worker)
+void playlist_advance()
+{
+	if (next_stage != STAGE_ADVANCING) return;
+	if (verbose) printf("-> playlist_advance(%s)\n", next_input.filepath);
+	
+	// The next track is playing, so it is no longer in the queue
+	pop_item( next_item );
+	
+	// Finished with the old track
+	finish_decoder_thread();
+	if (input_file->file) fclose( input_file->file );
+	free( input_file->filepath );
+	free( input_file->fullpath );
+	free_preload( input_file );
+	clear_hotcues();
+	
+	input_file->file = next_input.file;
+	input_file->file_stat = next_input.file_stat;
+	input_file->filepath = next_input.filepath;
+	input_file->fullpath = next_input.fullpath;
+	input_file->start_pos = next_input.start_pos;
+	input_file->end_pos = next_input.end_pos;
+	input_file->duration = next_input.duration;
+	input_file->bitrate = next_input.bitrate;
+	input_file->samplerate = next_input.samplerate;
+	input_file->framesize = next_input.framesize;
+	input_file->preload_buffer = next_input.preload_buffer;
+	input_file->preload_size = next_input.preload_size;
+	bzero( &next_input, sizeof(input_file_t) );
+	next_stage = STAGE_EMPTY;
+	
+	if (!quiet) printf("Playing next: %s\n", input_file->fullpath);
+	status_update( 1 );
+
+	if (get_state() == MADJACK_STATE_PLAYING ||
+	    get_state() == MADJACK_STATE_PAUSED)
+	{
+		// Decode the rest of the track into the ringbuffer, behind the pre-roll
+		if (!preroll_at_eof) restart_decoder_thread( input_file, preroll->length / SAMPLES_PER_FRAME );
+	}
+	else
+	{
+		// Stopped in the meantime: cue up the start of the new track
+		// (nothing decoded from the old one is any use)
+		warm_stopped = 0;
+		set_state( MADJACK_STATE_STOPPED );
+		do_cue( 0.0f );
+	}
+}
+
+
+// Returns 0 on success
+static
+int submit_command( command_type_t type, const char* path )
+{
+	command_t cmd;
+	
+	command_init( &cmd, type );
+	if (path && command_set_name( &cmd, path )) return -1;
+	return command_submit( &cmd );
+}
+
+
+// Look after the next track (called every tick by the playlist thread)
+static
+void check_playlist()
+{
+	enum madjack_state state = get_state();
+	unsigned int current;
+	char *head = NULL;
+	unsigned long head_id = 0;
+	
+	pthread_mutex_lock( &playlist_lock );
+	current = generation;
+	if (item_count) {
+		head = strdup( items[0].path );
+		head_id = items[0].id;
+	}
+	pthread_mutex_unlock( &playlist_lock );
+	
+	// Queue has changed since the next track was prepared ?
+	if (current != next_generation &&
+	    (__sync_bool_compare_and_swap( &next_stage, STAGE_READY, STAGE_EMPTY ) ||
+	     __sync_bool_compare_and_swap( &next_stage, STAGE_FAILED, STAGE_EMPTY )))
+	{
+		close_next();
+	}
+	
+	switch (next_stage) {
+		case STAGE_EMPTY:
+			if (!head) break;
+			next_generation = current;
+			next_item = head_id;
+			switch (prepare_next( head )) {
+				case 0:
+					next_stage = STAGE_READY;
+				break;
+				
+				case -2:
+					// Take it off the queue, rather than load it the slow way
+					pop_item( head_id );
+					free( head );
+					head = NULL;
+				// Fall through
+				
+				default:
+					next_stage = STAGE_FAILED;
+				break;
+			}
+		break;
+		
+		case STAGE_READY:
+			// Time to start crossfading ?
+			if (crossfade > 0.0f && state == MADJACK_STATE_PLAYING && can_take_over() &&
+			    input_file->duration - input_file->position <= crossfade)
+			{
+				next_stage = STAGE_FADE_PENDING;
+				if (submit_command( COMMAND_PLAYLIST_CROSSFADE, NULL ))
+					__sync_bool_compare_and_swap( &next_stage, STAGE_FADE_PENDING, STAGE_READY );
+			}
+		break;
+		
+		case STAGE_FADING:
+			// (the control worker may call it off at any point)
+			if (overlay_is_crossfading()) break;
+			if (!__sync_bool_compare_and_swap( &next_stage, STAGE_FADING, STAGE_STARTED )) break;
+		// Fall through
+		
+		case STAGE_STARTED:
+			if (!__sync_bool_compare_and_swap( &next_stage, STAGE_STARTED, STAGE_ADVANCING )) break;
+			if (submit_command( COMMAND_PLAYLIST_ADVANCE, NULL ))
+				__sync_bool_compare_and_swap( &next_stage, STAGE_ADVANCING, STAGE_STARTED );
+		break;
+		
+		default:
+		break;
+	}
+	
+	// Reached the end without the next track ready: load it the slow way
+	if (state != MADJACK_STATE_STOPPED) {
+		load_pending = 0;
+	} else if (head && !load_pending &&
+	           input_file->position >= input_file->duration &&
+	           (next_stage == STAGE_EMPTY || next_stage == STAGE_FAILED ||
+	            __sync_bool_compare_and_swap( &next_stage, STAGE_READY, STAGE_EMPTY )))
+	{
+		if (verbose) printf("Loading next track at the end of the last one.\n");
+		close_next();
+		next_stage = STAGE_EMPTY;
+		if (submit_command( COMMAND_LOAD, head ) == 0) {
+			pop_item( head_id );
+			submit_command( COMMAND_PLAY, NULL );
+			load_pending = 1;
+		}
+	}
+	
+	free( head );
+}
+
+
+static
+void* thread_playlist( void* arg )
+{
+	// (stop before JACK is shut down)
+	while (playlist_running && get_state() != MADJACK_STATE_QUIT) {
+		check_playlist();
+		usleep( PLAYLIST_TICK * 1000 );
+	}
+	
+	return NULL;
+}
+
+
+void init_playlist()
+{
+	int result;
+
+	rate = jack_get_sample_rate( client );
+	playlist_running = 1;
+	result = pthread_create( &playlist_thread, NULL, thread_playlist, NULL );
+	if (result) {
+		fprintf(stderr, "Error: return code from pthread_create() is %d\n", result);
+		exit(-1);
+	}
+}
+
+
+void finish_playlist()
+{
+	if (playlist_running) {
+		playlist_running = 0;
+		pthread_join( playlist_thread, NULL );
+	}
+	
+	playlist_clear();
+	close_next();
+	finish_pcm_buffer( preroll );
+	preroll = NULL;
+}
+
+
+unsigned long playlist_memory_usage()
+{
+	return pcm_buffer_bytes( preroll );
+}
@@ -0,0 +1,54 @@
+/*
+
+	playlist.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "madjack.h"
+
+#ifndef _PLAYLIST_H_
+#define _PLAYLIST_H_
+
+
+// Constants
+#define PLAYLIST_MAX			(256)		// Most tracks that can be queued
+#define PLAYLIST_PREROLL		(1.0)		// Seconds decoded into memory after any crossfade
+#define PLAYLIST_MAX_CROSSFADE	(30.0)		// Longest crossfade between tracks (in seconds)
+#define PLAYLIST_TICK			(10)		// Milliseconds between checks for the end of a track
+
+
+// Prototypes
+void init_playlist();
+void finish_playlist();
+int playlist_add( const char* path );
+int playlist_insert( unsigned int index, const char* path );
+int playlist_remove( unsigned int index );
+void playlist_clear();
+char** playlist_copy( unsigned int *count );
+void playlist_set_crossfade( float seconds );
+float playlist_get_crossfade();
+pcm_buffer_t* playlist_splice( jack_nframes_t nframes );
+void playlist_spliced( pcm_buffer_t *pcm, unsigned int offset );
+void playlist_crossfade();
+void playlist_cancel();
+void playlist_advance();
+unsigned long playlist_memory_usage();
+
+#endif
@@ -0,0 +1,137 @@
+/*
+
+	preload.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "madjack.h"
+#include "preload.h"
+#include "config.h"
+
+
+
+/*
+ * Read the whole of the input file into memory and replace the
+ * file handle with one that reads from the memory buffer. Once
+ * this has been done, the decoder never has to touch the disk.
+ *
+ * Returns 0 on success, or an errno value on failure.
+ */
+
+int preload_input_file( input_file_t *input )
+{
+	unsigned char* buffer = NULL;
+	FILE* memfile = NULL;
+	struct stat st;
+	off_t offset = 0;
+	int fd;
+	
+	// No file open ?
+	if (input->file==NULL) return EBADF;
+	fd = fileno( input->file );
+
+	// How big is the file ?
+	if (fstat( fd, &st )) return errno;
+	if (st.st_size <= 0) return EINVAL;
+
+#ifdef HAVE_POSIX_FADVISE
+	// Ask the kernel to start reading the whole file in the background
+	posix_fadvise( fd, 0, st.st_size, POSIX_FADV_SEQUENTIAL );
+	posix_fadvise( fd, 0, st.st_size, POSIX_FADV_WILLNEED );
+#endif
+
+	// Allocate memory for the whole file
+	buffer = malloc( st.st_size );
+	if (buffer == NULL) return ENOMEM;
+
+	// Read the file in using large reads
+	while (offset < st.st_size) {
+		size_t len = st.st_size - offset;
+		ssize_t bytes;
+		
+		if (len > PRELOAD_CHUNK_SIZE) len = PRELOAD_CHUNK_SIZE;
+		
+		bytes = pread( fd, buffer + offset, len, offset );
+		if (bytes < 0) {
+			int err = errno;
+			if (err == EINTR) continue;
+			free( buffer );
+			return err;
+		} else if (bytes == 0) {
+			// File got shorter while we were reading it
+			break;
+		}
+		
+		offset += bytes;
+	}
+	
+	// Create a file handle that reads from memory
+	memfile = fmemopen( buffer, offset, "r" );
+	if (memfile == NULL) {
+		int err = errno;
+		free( buffer );
+		return err;
+	}
+	
+	// Swap the file handles over
+	fclose( input->file );
+	input->file = memfile;
+	input->preload_buffer = buffer;
+	input->preload_size = offset;
+	
+	if (verbose) printf("Preloaded %lu bytes into memory.\n", input->preload_size);
+
+	return 0;
+}
+
+
+// Open a second file handle on the input file, for decoding
+// audio alongside the decoder thread
+FILE* reopen_input_file( input_file_t *input )
+{
+	if (input->preload_buffer) {
+		return fmemopen( input->preload_buffer, input->preload_size, "r" );
+	} else if (input->fullpath) {
+		return fopen( input->fullpath, "r" );
+	} else {
+		return NULL;
+	}
+}
+
+
+// Free the memory used by a preloaded file
+// (call after the memory file handle has been closed)
+void free_preload( input_file_t *input )
+{
+	if (input->preload_buffer) {
+		free( input->preload_buffer );
+		input->preload_buffer = NULL;
+	}
+	input->preload_size = 0;
+}
+
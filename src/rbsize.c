@@ -0,0 +1,326 @@
+/*
+
+	rbsize.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "madjack.h"
+#include "maddecode.h"
+#include "readahead.h"
+#include "rbsize.h"
+#include "config.h"
+
+
+/*
+ * The ringbuffers are allocated at the full size given by -R, but when
+ * a minimum size is given with -b, the decoder only keeps a target
+ * amount of audio in them. Every few seconds the lowest fill level
+ * seen while playing, and the longest time taken to decode a frame,
+ * are used to move the target between the two sizes.
+ *
+ * The power-of-two part of each ringbuffer in use follows the target.
+ * It is changed by the decoder thread when the audio in the buffer
+ * doesn't wrap round, so the JACK callback never sees it change under
+ * it, and memory that is no longer used is given back to the system.
+ */
+
+
+// ------- Globals -------
+float rb_min_duration = 0.0f;			// Smallest ringbuffer (in seconds), 0 to disable
+
+static int rb_adaptive = 0;				// Set when adaptive sizing is enabled
+static size_t rb_allocated = 0;			// Bytes allocated for each ringbuffer
+static size_t rb_min_target = 0;		// Smallest target fill (in bytes)
+static size_t rb_max_target = 0;		// Largest target fill (in bytes)
+static size_t rb_period_target = 0;		// Smallest fill for the JACK period (in bytes)
+static size_t rb_target = 0;			// Amount the decoder keeps in the ringbuffer
+static size_t rb_capacity = 0;			// Part of the ringbuffer that should be in use
+
+static unsigned long long window_start = 0;		// Time the current window started
+static unsigned long long last_output = 0;		// Time the decoder last wrote audio
+static size_t window_min_fill = 0;				// Lowest fill level in this window
+static unsigned long long window_max_gap = 0;	// Longest refill latency in this window
+static int window_played = 0;					// Set if deck was playing in this window
+static unsigned int quiet_windows = 0;			// Windows in a row with plenty of margin
+
+static float last_margin = 0.0f;				// Lowest fill in the last window (in seconds)
+static float last_refill = 0.0f;				// Longest refill latency in the last window
+static float history[RBSIZE_HISTORY];			// Target after each window (in seconds)
+static unsigned int history_pos = 0;
+
+
+
+static
+float bytes_to_seconds( size_t bytes )
+{
+	return (float)bytes / (jack_get_sample_rate( client ) * sizeof(float));
+}
+
+
+// Smallest power of two that holds the target and a frame to spare
+static
+size_t capacity_for_target( size_t target )
+{
+	size_t capacity = 1;
+	
+	while (capacity < target + SAMPLES_PER_FRAME * sizeof(float) * 2)
+		capacity <<= 1;
+	if (capacity > rb_allocated) capacity = rb_allocated;
+	
+	return capacity;
+}
+
+
+/*
+ * Change the part of a ringbuffer in use, while the callback may be
+ * reading from it. Only done while the audio in the buffer sits below
+ * the smaller of the two sizes without wrapping round, so both sizes
+ * give the same read space and read pointer.
+ *
+ * Returns 1 on success, or 0 if it should be tried again later.
+ */
+
+static
+int resize_ringbuffer( jack_ringbuffer_t *rb, size_t size )
+{
+	size_t old = rb->size;
+	size_t r = rb->read_ptr;
+	size_t w = rb->write_ptr;
+	
+	if (size == old) return 1;
+	if (r > w || w >= size) return 0;
+	
+	// (size & size_mask) must stay zero in between
+	if (size > old) {
+		rb->size = size;
+		__sync_synchronize();
+		rb->size_mask = size - 1;
+	} else {
+		rb->size_mask = size - 1;
+		__sync_synchronize();
+		rb->size = size;
+	}
+	
+#ifdef HAVE_MADVISE
+	// Give back the memory that is no longer used
+	// (unless it is locked into memory)
+	if (size < old && !rb->mlocked) {
+		uintptr_t page = sysconf( _SC_PAGESIZE );
+		uintptr_t start = ((uintptr_t)rb->buf + size + page - 1) & ~(page - 1);
+		uintptr_t end = (uintptr_t)rb->buf + old;
+		if (end > start) madvise( (void*)start, end - start, MADV_DONTNEED );
+	}
+#endif
+	
+	return 1;
+}
+
+
+// Try to bring both ringbuffers to the capacity wanted
+static
+void apply_capacity()
+{
+	resize_ringbuffer( ringbuffer[0], rb_capacity );
+	resize_ringbuffer( ringbuffer[1], rb_capacity );
+}
+
+
+// Decide whether to grow or shrink the target, at the end of a window
+static
+void end_of_window()
+{
+	size_t need = (window_max_gap / 1000000.0f) * RBSIZE_SAFETY
+	              * jack_get_sample_rate( client ) * sizeof(float);
+	size_t target = rb_target;
+	
+	last_refill = window_max_gap / 1000000.0f;
+	
+	if (window_played) {
+		last_margin = bytes_to_seconds( window_min_fill );
+	
+		if (window_min_fill < rb_target / 2 || window_min_fill < need) {
+			// Decoder struggled to keep up - grow straight away
+			target = rb_target * 2;
+			if (target < need * 2) target = need * 2;
+			quiet_windows = 0;
+		} else if (++quiet_windows >= RBSIZE_QUIET_WINDOWS) {
+			// Plenty of margin for a while - shrink slowly
+			target = rb_target / 4 * 3;
+			if (target < need * 2) target = need * 2;
+			quiet_windows = 0;
+		}
+		
+		// Keep within bounds (and a whole number of samples)
+		if (target < rb_min_target) target = rb_min_target;
+		if (target < rb_period_target) target = rb_period_target;
+		if (target > rb_max_target) target = rb_max_target;
+		target &= ~(sizeof(float) - 1);
+		
+		if (target != rb_target) {
+			if (verbose) printf("Ringbuffer target fill changing from %2.2f to %2.2f seconds.\n",
+			                    bytes_to_seconds( rb_target ), bytes_to_seconds( target ));
+			rb_target = target;
+			rb_capacity = capacity_for_target( target );
+		}
+	}
+	
+	history[history_pos] = bytes_to_seconds( rb_target );
+	history_pos = (history_pos + 1) % RBSIZE_HISTORY;
+	
+	// Start a new window
+	window_min_fill = rb_allocated;
+	window_max_gap = 0;
+	window_played = 0;
+}
+
+
+// Called by the decoder thread before it waits for room in the ringbuffer
+void rbsize_before_output()
+{
+	unsigned long long now;
+	size_t fill;
+	
+	if (!rb_adaptive) return;
+	now = get_usecs();
+	
+	// Time taken to decode the frame (including reading the file)
+	if (last_output && now - last_output > window_max_gap)
+		window_max_gap = now - last_output;
+	
+	// Lowest fill level while the callback is emptying the ringbuffer
+	if (get_state() == MADJACK_STATE_PLAYING) {
+		fill = jack_ringbuffer_read_space( ringbuffer[0] );
+		if (fill < window_min_fill) window_min_fill = fill;
+		window_played = 1;
+	}
+	
+	if (now - window_start > RBSIZE_WINDOW * 1000000) {
+		end_of_window();
+		window_start = now;
+	}
+	
+	// Change size if waiting to
+	if (ringbuffer[0]->size != rb_capacity ||
+	    ringbuffer[1]->size != rb_capacity) apply_capacity();
+}
+
+
+// Called by the decoder thread after writing audio to the ringbuffer
+void rbsize_after_output()
+{
+	if (rb_adaptive) last_output = get_usecs();
+}
+
+
+// Is there less than 'needed' bytes before the target fill ?
+int rbsize_is_full( size_t needed )
+{
+	if (jack_ringbuffer_write_space( ringbuffer[0] ) < needed) return 1;
+	if (rb_adaptive && jack_ringbuffer_read_space( ringbuffer[0] ) + needed > rb_target) return 1;
+	return 0;
+}
+
+
+// Called when the ringbuffers are emptied, before starting the decoder
+void reset_rbsize()
+{
+	jack_ringbuffer_reset( ringbuffer[0] );
+	jack_ringbuffer_reset( ringbuffer[1] );
+	
+	if (rb_adaptive) {
+		apply_capacity();
+		last_output = 0;
+	}
+}
+
+
+void rbsize_get_stats( float *target, unsigned long *capacity,
+                       float *margin, float *refill, float *hist )
+{
+	unsigned int i;
+	
+	*target = bytes_to_seconds( rb_adaptive ? rb_target : ringbuffer[0]->size );
+	*capacity = ringbuffer[0]->size;
+	*margin = last_margin;
+	*refill = last_refill;
+	
+	// Oldest first
+	for (i=0; i<RBSIZE_HISTORY; i++) {
+		hist[i] = history[(history_pos + i) % RBSIZE_HISTORY];
+	}
+}
+
+
+// Called when the JACK period size changes
+void rbsize_set_period( jack_nframes_t nframes )
+{
+	rb_period_target = RBSIZE_MIN_PERIODS * nframes * sizeof(float);
+	
+	// The decoder writes a whole MPEG frame at a time, so there has
+	// to be room for one on top of a period, or it would never write
+	if (rb_period_target < (SAMPLES_PER_FRAME + nframes) * sizeof(float))
+		rb_period_target = (SAMPLES_PER_FRAME + nframes) * sizeof(float);
+	
+	if (!rb_adaptive || rb_target >= rb_period_target) return;
+	
+	// Grow now, rather than waiting for the end of the window
+	rb_target = rb_period_target;
+	if (rb_target > rb_max_target) rb_target = rb_max_target;
+	rb_capacity = capacity_for_target( rb_target );
+}
+
+
+void init_rbsize()
+{
+	size_t bytes_per_sec = jack_get_sample_rate( client ) * sizeof(float);
+	
+	rb_allocated = ringbuffer[0]->size;
+	
+	// Adaptive sizing disabled ?
+	if (rb_min_duration <= 0.0f || rb_min_duration >= rb_duration) return;
+	
+	rb_min_target = (size_t)(rb_min_duration * bytes_per_sec) & ~(sizeof(float) - 1);
+	rb_max_target = (size_t)(rb_duration * bytes_per_sec) & ~(sizeof(float) - 1);
+	if (rb_max_target > rb_allocated - SAMPLES_PER_FRAME * sizeof(float) * 2)
+		rb_max_target = rb_allocated - SAMPLES_PER_FRAME * sizeof(float) * 2;
+	
+	// Start big, and shrink when things are quiet
+	rb_target = rb_max_target;
+	if (rb_period_target == 0) rbsize_set_period( jack_get_buffer_size( client ) );
+	if (rb_max_target < rb_period_target) {
+		fprintf(stderr, "Warning: ringbuffer is too small to size adaptively.\n");
+		return;
+	}
+	if (rb_min_target < rb_period_target) rb_min_target = rb_period_target;
+	if (rb_min_target > rb_max_target) rb_min_target = rb_max_target;
+	rb_capacity = capacity_for_target( rb_target );
+	window_start = get_usecs();
+	window_min_fill = rb_allocated;
+	rb_adaptive = 1;
+	
+	if (verbose) printf("Ringbuffer target fill will be between %2.2f and %2.2f seconds.\n",
+	                    bytes_to_seconds( rb_min_target ), bytes_to_seconds( rb_max_target ));
+}
@@ -0,0 +1,52 @@
+/*
+
+	rbsize.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "madjack.h"
+
+#ifndef _RBSIZE_H_
+#define _RBSIZE_H_
+
+
+// Constants
+#define RBSIZE_WINDOW			(5.0f)		// Seconds between each resizing decision
+#define RBSIZE_SAFETY			(4.0f)		// Keep this many times the worst refill latency
+#define RBSIZE_QUIET_WINDOWS	(6)			// Quiet windows before shrinking
+#define RBSIZE_HISTORY			(8)			// Number of window results to keep
+#define RBSIZE_MIN_PERIODS		(4)			// Never aim for fewer JACK periods than this
+
+
+// Globals
+extern float rb_min_duration;
+
+
+// Prototypes
+void init_rbsize();
+void reset_rbsize();
+void rbsize_set_period( jack_nframes_t nframes );
+int rbsize_is_full( size_t needed );
+void rbsize_before_output();
+void rbsize_after_output();
+void rbsize_get_stats( float *target, unsigned long *capacity,
+                       float *margin, float *refill, float *history );
+
+#endif
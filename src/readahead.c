@@ -0,0 +1,288 @@
+/*
+
+	readahead.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include <pthread.h>
+#include <jack/ringbuffer.h>
+
+#include "madjack.h"
+#include "readahead.h"
+#include "config.h"
+
+
+// ------- Globals -------
+float readahead_duration = 0.0f;		// Length of read-ahead window (in seconds)
+
+static jack_ringbuffer_t *byte_ringbuffer = NULL;	// Compressed bytes read from disk
+static pthread_t readahead_thread;				// The I/O thread
+static int readahead_thread_exists = 0;		// Set if I/O thread has been created
+static int terminate_readahead_thread = 0;		// Set to 1 to tell thread to stop
+static int readahead_eof = 0;					// Set when I/O thread reaches end of file
+static unsigned long readahead_starved = 0;	// Number of times decoder waited for I/O
+
+// Histogram of read latencies
+static unsigned long read_latency_hist[READ_LATENCY_BUCKETS];
+static unsigned long read_latency_count = 0;
+static unsigned long read_latency_max = 0;
+
+
+
+// Get the current time in microseconds
+unsigned long long get_usecs()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+// Add the time taken by a single read to the histogram
+void record_read_latency( unsigned long usecs )
+{
+	unsigned int bucket = 0;
+	
+	while (bucket < READ_LATENCY_BUCKETS-1 && (usecs >> bucket) > 1)
+		bucket++;
+	
+	read_latency_hist[bucket]++;
+	read_latency_count++;
+	if (usecs > read_latency_max) read_latency_max = usecs;
+}
+
+
+// Get the upper bound of a percentile of read latency (in milliseconds)
+float get_read_latency_percentile( float percentile )
+{
+	unsigned long target = read_latency_count * percentile / 100.0f;
+	unsigned long total = 0;
+	unsigned int i;
+	
+	if (read_latency_count == 0) return 0.0f;
+
+	for (i=0; i < READ_LATENCY_BUCKETS; i++) {
+		total += read_latency_hist[i];
+		if (total > target) break;
+	}
+	
+	if (i >= READ_LATENCY_BUCKETS) i = READ_LATENCY_BUCKETS-1;
+	return (float)(2UL << i) / 1000.0f;
+}
+
+
+// Get the longest time a single read took (in milliseconds)
+float get_read_latency_max()
+{
+	return (float)read_latency_max / 1000.0f;
+}
+
+
+// Number of times that the decoder had to wait for the I/O thread
+unsigned long get_readahead_starved()
+{
+	return readahead_starved;
+}
+
+
+
+static
+void *thread_readahead(void *data)
+{
+	input_file_t *input = data;
+#ifdef HAVE_POSIX_FADVISE
+	int fd = fileno( input->file );
+#endif
+	size_t window = jack_ringbuffer_write_space( byte_ringbuffer );
+	size_t since_advice = window;
+	size_t low_water = window / 2;
+	
+	if (low_water > READAHEAD_CHUNK_SIZE) low_water = READAHEAD_CHUNK_SIZE;
+
+	if (verbose) printf("Read-ahead thread started.\n");
+
+#ifdef HAVE_POSIX_FADVISE
+	posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+#endif
+
+	while (!terminate_readahead_thread) {
+		jack_ringbuffer_data_t vec[2];
+		unsigned long long start;
+		size_t len, bytes;
+		
+		// Wait until there is a chunk's worth of room in the ring
+		if (jack_ringbuffer_write_space( byte_ringbuffer ) < low_water) {
+			usleep(10000);
+			continue;
+		}
+		
+		// Read no further than the end of the ring
+		jack_ringbuffer_get_write_vector( byte_ringbuffer, vec );
+		len = vec[0].len;
+		if (len > READAHEAD_CHUNK_SIZE) len = READAHEAD_CHUNK_SIZE;
+
+#ifdef HAVE_POSIX_FADVISE
+		// Tell the kernel what we are going to want next
+		if (since_advice >= window / 2) {
+			posix_fadvise( fd, ftell( input->file ), window, POSIX_FADV_WILLNEED );
+			since_advice = 0;
+		}
+#endif
+
+		// Read straight into the ringbuffer
+		start = get_usecs();
+		bytes = fread( vec[0].buf, 1, len, input->file );
+		record_read_latency( get_usecs() - start );
+		
+		jack_ringbuffer_write_advance( byte_ringbuffer, bytes );
+		since_advice += bytes;
+		
+		// Reached the end of the file ?
+		if (bytes < len) {
+			if (ferror( input->file ))
+				fprintf(stderr, "Warning: read error in read-ahead thread.\n");
+			readahead_eof = 1;
+			break;
+		}
+	}
+
+	if (verbose) printf("Read-ahead thread exiting.\n");
+	
+	pthread_exit(NULL);
+}
+
+
+// Read bytes from the read-ahead window, waiting if it is empty
+// Returns 0 at end of file or if the I/O thread has been stopped
+size_t readahead_read( unsigned char* buffer, size_t len )
+{
+	size_t bytes = 0;
+	int waited = 0;
+
+	while (readahead_thread_exists && !terminate_readahead_thread) {
+		bytes = jack_ringbuffer_read( byte_ringbuffer, (char*)buffer, len );
+		if (bytes || readahead_eof) break;
+		
+		// Decoder has caught up with the disk
+		if (!waited) {
+			readahead_starved++;
+			waited = 1;
+		}
+		usleep(1000);
+	}
+	
+	return bytes;
+}
+
+
+// Returns true if the I/O thread is supplying the decoder
+int readahead_is_running()
+{
+	return readahead_thread_exists;
+}
+
+
+// Returns true once everything read from disk has been consumed
+int readahead_at_eof()
+{
+	return readahead_eof && jack_ringbuffer_read_space( byte_ringbuffer ) == 0;
+}
+
+
+void start_readahead_thread( input_file_t *input )
+{
+	int result;
+	
+	// Read-ahead disabled ?
+	if (byte_ringbuffer == NULL) return;
+	
+	// Stop the previous thread
+	finish_readahead_thread();
+
+	// Empty out the ring
+	jack_ringbuffer_reset( byte_ringbuffer );
+	terminate_readahead_thread = 0;
+	readahead_eof = 0;
+
+	// Start the I/O thread
+	result = pthread_create(&readahead_thread, NULL, thread_readahead, input);
+	if (result) {
+		fprintf(stderr, "Error: return code from pthread_create() is %d\n", result);
+		exit(-1);
+	} else {
+		readahead_thread_exists = 1;
+	}
+}
+
+
+void finish_readahead_thread()
+{
+	if (readahead_thread_exists) {
+		int result;
+		
+		// Signal the thread to terminate
+		terminate_readahead_thread = 1;
+		
+		result = pthread_join( readahead_thread, NULL );
+		if (result) {
+			fprintf(stderr, "Warning: pthread_join() failed: %s\n", strerror(result));
+		} else {
+			readahead_thread_exists = 0;
+		}
+	}
+}
+
+
+void init_readahead()
+{
+	size_t size = readahead_duration * READAHEAD_BYTES_PER_SEC;
+
+	// Read-ahead disabled ?
+	if (size == 0) return;
+	
+	if (verbose) printf("Size of the read-ahead window is %2.2f seconds (%d bytes).\n",
+	                    readahead_duration, (int)size );
+	
+	byte_ringbuffer = jack_ringbuffer_create( size );
+	if (!byte_ringbuffer) {
+		fprintf(stderr, "Cannot create read-ahead ringbuffer.\n");
+		exit(1);
+	}
+}
+
+
+void finish_readahead()
+{
+	finish_readahead_thread();
+	
+	if (byte_ringbuffer) {
+		jack_ringbuffer_free( byte_ringbuffer );
+		byte_ringbuffer = NULL;
+	}
+}
+
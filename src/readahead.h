@@ -0,0 +1,55 @@
+/*
+
+	readahead.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "madjack.h"
+
+#ifndef _READAHEAD_H_
+#define _READAHEAD_H_
+
+
+// Constants
+#define READAHEAD_CHUNK_SIZE		(16384)
+#define READAHEAD_BYTES_PER_SEC		(40000)		// Enough for 320kbps
+#define READ_LATENCY_BUCKETS		(32)		// Powers of two microseconds
+
+
+// Globals
+extern float readahead_duration;
+
+
+// Prototypes
+void init_readahead();
+void finish_readahead();
+void start_readahead_thread( input_file_t *input );
+void finish_readahead_thread();
+int readahead_is_running();
+int readahead_at_eof();
+size_t readahead_read( unsigned char* buffer, size_t len );
+
+unsigned long long get_usecs();
+void record_read_latency( unsigned long usecs );
+float get_read_latency_percentile( float percentile );
+float get_read_latency_max();
+unsigned long get_readahead_starved();
+
+#endif
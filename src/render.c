@@ -0,0 +1,204 @@
+/*
+
+	render.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "madjack.h"
+#include "maddecode.h"
+#include "readahead.h"
+#include "render.h"
+#include "config.h"
+
+
+/*
+ * Render mode decodes a file straight to a WAV file, as fast as
+ * possible, without connecting to JACK. The normal decoder thread
+ * fills the ringbuffers, and this thread empties them instead of the
+ * JACK callback.
+ */
+
+
+static
+void write_le16( FILE* file, unsigned int value )
+{
+	fputc( value & 0xFF, file );
+	fputc( (value >> 8) & 0xFF, file );
+}
+
+
+static
+void write_le32( FILE* file, unsigned long value )
+{
+	write_le16( file, value & 0xFFFF );
+	write_le16( file, (value >> 16) & 0xFFFF );
+}
+
+
+// Write a header for 16-bit stereo PCM audio
+static
+void write_wav_header( FILE* file, unsigned int samplerate, unsigned long frames )
+{
+	unsigned long data_bytes = frames * 2 * 2;
+
+	fwrite( "RIFF", 1, 4, file );
+	write_le32( file, 36 + data_bytes );
+	fwrite( "WAVE", 1, 4, file );
+	
+	fwrite( "fmt ", 1, 4, file );
+	write_le32( file, 16 );
+	write_le16( file, 1 );					// PCM
+	write_le16( file, 2 );					// Channels
+	write_le32( file, samplerate );
+	write_le32( file, samplerate * 2 * 2 );	// Bytes per second
+	write_le16( file, 2 * 2 );				// Bytes per frame
+	write_le16( file, 16 );					// Bits per sample
+	
+	fwrite( "data", 1, 4, file );
+	write_le32( file, data_bytes );
+}
+
+
+// Convert a chunk of audio to 16-bit and write it to the file
+static
+void write_wav_samples( FILE* file, float* left, float* right, unsigned int frames )
+{
+	unsigned int i, c;
+	
+	for (i=0; i<frames; i++) {
+		for (c=0; c<2; c++) {
+			float sample = (c==0 ? left[i] : right[i]) * 32768.0f;
+			if (sample > 32767.0f) sample = 32767.0f;
+			if (sample < -32768.0f) sample = -32768.0f;
+			write_le16( file, (unsigned int)(int)sample );
+		}
+	}
+}
+
+
+// Decode a file to a WAV file at maximum speed
+// Returns 0 on success
+int render_to_file( const char* filepath, const char* outpath )
+{
+	float left[RENDER_CHUNK], right[RENDER_CHUNK];
+	unsigned long frames = 0;
+	unsigned long long start;
+	float seconds, elapsed;
+	FILE* out = NULL;
+	int c;
+	
+	// Reading ahead isn't needed when nothing is waiting
+	readahead_duration = 0.0f;
+	
+	input_file->file = fopen( filepath, "r" );
+	if (input_file->file == NULL) {
+		fprintf(stderr, "Failed to open input file: %s: %s\n", filepath, strerror( errno ));
+		return 1;
+	}
+	input_file->filepath = strdup( filepath );
+	
+	out = fopen( outpath, "wb" );
+	if (out == NULL) {
+		fprintf(stderr, "Failed to open output file: %s: %s\n", outpath, strerror( errno ));
+		return 1;
+	}
+	
+	// Leave room for the header (the sample rate isn't known yet)
+	write_wav_header( out, 0, 0 );
+	
+	for (c=0; c<2; c++) {
+		if (!(ringbuffer[c] = jack_ringbuffer_create( RENDER_RB_SIZE ))) {
+			fprintf(stderr, "Cannot create ringbuffer.\n");
+			exit(1);
+		}
+	}
+	
+	if (!quiet) printf("Rendering: %s -> %s\n", filepath, outpath);
+	start = get_usecs();
+	start_decoder_thread( input_file, 0.0f );
+	
+	while (get_state() != MADJACK_STATE_ERROR) {
+		size_t avail;
+		
+		// Let the decoder fill the ringbuffer first, as it would normally
+		if (get_state() == MADJACK_STATE_LOADING) {
+			usleep( 100 );
+			continue;
+		} else if (get_state() == MADJACK_STATE_READY) {
+			set_state( MADJACK_STATE_PLAYING );
+		}
+	
+		avail = jack_ringbuffer_read_space( ringbuffer[0] );
+		if (jack_ringbuffer_read_space( ringbuffer[1] ) < avail)
+			avail = jack_ringbuffer_read_space( ringbuffer[1] );
+		avail /= sizeof(float);
+	
+		if (avail == 0) {
+			// Finished ? (the decoder may have written its last
+			// samples just before it stopped, so look again)
+			if (!is_decoding) {
+				__sync_synchronize();
+				if (jack_ringbuffer_read_space( ringbuffer[0] ) == 0 ||
+				    jack_ringbuffer_read_space( ringbuffer[1] ) == 0) break;
+				continue;
+			}
+			usleep( 100 );
+			continue;
+		}
+		
+		if (avail > RENDER_CHUNK) avail = RENDER_CHUNK;
+		jack_ringbuffer_read( ringbuffer[0], (char*)left, avail * sizeof(float) );
+		jack_ringbuffer_read( ringbuffer[1], (char*)right, avail * sizeof(float) );
+		write_wav_samples( out, left, right, avail );
+		frames += avail;
+	}
+	
+	finish_decoder_thread();
+	
+	// Go back and fill in the header
+	fseek( out, 0, SEEK_SET );
+	write_wav_header( out, input_file->samplerate, frames );
+	fclose( out );
+	
+	for (c=0; c<2; c++) {
+		jack_ringbuffer_free( ringbuffer[c] );
+		ringbuffer[c] = NULL;
+	}
+	
+	if (get_state() == MADJACK_STATE_ERROR) {
+		fprintf(stderr, "Rendering failed: %s\n", error_string);
+		return 1;
+	}
+	
+	// Report on how fast it went
+	elapsed = (get_usecs() - start) / 1000000.0f;
+	seconds = input_file->samplerate ? (float)frames / input_file->samplerate : 0.0f;
+	if (!quiet) {
+		printf("Rendered %2.2f seconds of audio in %2.2f seconds (%2.1fx real time).\n",
+		       seconds, elapsed, elapsed > 0.0f ? seconds / elapsed : 0.0f);
+	}
+	
+	return 0;
+}
@@ -0,0 +1,281 @@
+/*
+
+	rtmem.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "madjack.h"
+#include "rtmem.h"
+#include "config.h"
+
+
+/*
+ * Memory that the JACK callback touches must never be swapped out or
+ * faulted in while it is running. With -L, the ringbuffers and the
+ * read buffer come out of an arena that is locked into memory and
+ * written to once up front; with -H, the arena is backed by huge pages
+ * (explicit ones if the system has any reserved, otherwise transparent
+ * ones), so that it takes fewer TLB entries.
+ *
+ * PCM buffers are allocated and freed as tracks are loaded, so they
+ * are locked in place rather than coming out of the arena.
+ */
+
+
+// ------- Globals -------
+int rtmem_lock = 0;						// Lock memory used by the JACK callback
+int rtmem_huge = 0;						// Back the arena with huge pages
+
+static char *arena = NULL;				// Start of the arena
+static size_t arena_size = 0;			// Size of the arena (in bytes)
+static size_t arena_used = 0;			// Bytes handed out so far
+static int arena_locked = 0;			// Set if the arena was locked
+static unsigned long locked_bytes = 0;	// Total bytes locked (arena and PCM buffers)
+static unsigned long peak_locked_bytes = 0;	// Most bytes locked at once
+static struct rusage usage_at_start;	// Page faults before we started
+
+
+
+// Map the arena, trying explicit huge pages first if asked for
+static
+char* map_arena( size_t *size, const char **kind )
+{
+	char *ptr = MAP_FAILED;
+	
+	*kind = "none";
+
+#ifdef MAP_HUGETLB
+	if (rtmem_huge) {
+		size_t huge = (*size + RTMEM_HUGE_PAGE_SIZE - 1) & ~(size_t)(RTMEM_HUGE_PAGE_SIZE - 1);
+		ptr = mmap( NULL, huge, PROT_READ | PROT_WRITE,
+		            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+		if (ptr != MAP_FAILED) {
+			*size = huge;
+			*kind = "explicit";
+			return ptr;
+		}
+		if (verbose) printf("No explicit huge pages available: %s\n", strerror( errno ));
+	}
+#endif
+
+	ptr = mmap( NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if (ptr == MAP_FAILED) return NULL;
+
+#ifdef MADV_HUGEPAGE
+	if (rtmem_huge && madvise( ptr, *size, MADV_HUGEPAGE ) == 0) {
+		*kind = "transparent";
+	}
+#endif
+
+	return ptr;
+}
+
+
+// Create the arena (if -L or -H was given)
+void init_rtmem( size_t size )
+{
+	const char *kind = NULL;
+	
+	getrusage( RUSAGE_SELF, &usage_at_start );
+	
+	// Arena disabled ?
+	if (!rtmem_lock && !rtmem_huge) return;
+	
+	arena = map_arena( &size, &kind );
+	if (arena == NULL) {
+		fprintf(stderr, "Warning: failed to map memory for audio buffers: %s\n", strerror( errno ));
+		return;
+	}
+	arena_size = size;
+	arena_used = 0;
+	
+	// Lock it, so it can't be swapped out
+	if (rtmem_lock) {
+		if (mlock( arena, arena_size )) {
+			fprintf(stderr, "Warning: failed to lock memory for audio buffers: %s\n", strerror( errno ));
+		} else {
+			arena_locked = 1;
+			locked_bytes += arena_size;
+			peak_locked_bytes = locked_bytes;
+		}
+	}
+	
+	// Touch every page now, rather than in the JACK callback
+	memset( arena, 0, arena_size );
+	
+	// (and don't count the faults that took in the session's total)
+	getrusage( RUSAGE_SELF, &usage_at_start );
+	
+	if (!quiet) printf("Audio buffer arena is %lu bytes (%slocked, huge pages: %s).\n",
+	                   (unsigned long)arena_size, arena_locked ? "" : "not ", kind);
+}
+
+
+void finish_rtmem()
+{
+	struct rusage usage;
+
+	// Report on how well it worked
+	getrusage( RUSAGE_SELF, &usage );
+	if (!quiet) {
+		printf("Memory locked: at most %lu bytes.\n", peak_locked_bytes);
+		printf("Page faults during session: %ld minor, %ld major.\n",
+		       usage.ru_minflt - usage_at_start.ru_minflt,
+		       usage.ru_majflt - usage_at_start.ru_majflt);
+	}
+
+	if (arena) {
+		if (arena_locked) munlock( arena, arena_size );
+		munmap( arena, arena_size );
+		arena = NULL;
+	}
+}
+
+
+// Allocate memory from the arena
+// Returns NULL if there is no arena, or there isn't enough room left
+void* rtmem_alloc( size_t size )
+{
+	void* ptr;
+	
+	if (arena == NULL) return NULL;
+	
+	size = (size + RTMEM_ALIGN - 1) & ~(size_t)(RTMEM_ALIGN - 1);
+	if (arena_used + size > arena_size) return NULL;
+	
+	ptr = arena + arena_used;
+	arena_used += size;
+	
+	return ptr;
+}
+
+
+// Did this memory come from the arena ?
+int rtmem_owns( void* ptr )
+{
+	return (arena && (char*)ptr >= arena && (char*)ptr < arena + arena_size);
+}
+
+
+// Space in the arena needed for a ringbuffer of 'sz' bytes
+size_t rtmem_ringbuffer_bytes( size_t sz )
+{
+	size_t size = 1;
+	
+	while (size < sz) size <<= 1;
+	
+	return size + sizeof(jack_ringbuffer_t) + RTMEM_ALIGN * 2;
+}
+
+
+// Create a ringbuffer in the arena (or using JACK if there isn't one)
+jack_ringbuffer_t* rtmem_ringbuffer_create( size_t sz )
+{
+	jack_ringbuffer_t* rb = NULL;
+	size_t size = 1;
+	
+	// Same size that JACK would use
+	while (size < sz) size <<= 1;
+	
+	if (arena && arena_size - arena_used >= rtmem_ringbuffer_bytes( sz )) {
+		rb = rtmem_alloc( sizeof(jack_ringbuffer_t) );
+		rb->buf = rtmem_alloc( size );
+		rb->size = size;
+		rb->size_mask = size - 1;
+		rb->write_ptr = 0;
+		rb->read_ptr = 0;
+		rb->mlocked = arena_locked;
+		return rb;
+	}
+	
+	// Fall back to the heap
+	rb = jack_ringbuffer_create( sz );
+	if (rb && rtmem_lock) {
+		if (jack_ringbuffer_mlock( rb )) {
+			fprintf(stderr, "Warning: failed to lock ringbuffer memory.\n");
+		} else {
+			locked_bytes += rb->size;
+			peak_locked_bytes = locked_bytes;
+		}
+	}
+	
+	return rb;
+}
+
+
+void rtmem_ringbuffer_free( jack_ringbuffer_t* rb )
+{
+	if (rb == NULL || rtmem_owns( rb )) return;
+	jack_ringbuffer_free( rb );
+}
+
+
+/*
+ * Allocate memory on the heap for a buffer the JACK callback reads.
+ * If -L was given, it is page aligned (so that freeing it doesn't
+ * unlock pages used by anything else), locked and touched.
+ * 'locked' is set if it was locked.
+ */
+
+void* rtmem_malloc( size_t size, int *locked )
+{
+	size_t page = sysconf( _SC_PAGESIZE );
+	void* ptr = NULL;
+	
+	*locked = 0;
+	if (!rtmem_lock) return malloc( size );
+	
+	size = (size + page - 1) & ~(page - 1);
+	if (posix_memalign( &ptr, page, size )) return NULL;
+	
+	if (mlock( ptr, size ) == 0) {
+		*locked = 1;
+		__sync_fetch_and_add( &locked_bytes, size );
+		if (locked_bytes > peak_locked_bytes) peak_locked_bytes = locked_bytes;
+	} else if (verbose) {
+		fprintf(stderr, "Warning: failed to lock buffer: %s\n", strerror( errno ));
+	}
+	memset( ptr, 0, size );
+	
+	return ptr;
+}
+
+
+void rtmem_free( void* ptr, size_t size, int locked )
+{
+	size_t page = sysconf( _SC_PAGESIZE );
+
+	if (ptr == NULL) return;
+	
+	if (locked) {
+		size = (size + page - 1) & ~(page - 1);
+		munlock( ptr, size );
+		__sync_fetch_and_sub( &locked_bytes, size );
+	}
+	free( ptr );
+}
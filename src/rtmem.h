@@ -0,0 +1,51 @@
+/*
+
+	rtmem.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include <jack/ringbuffer.h>
+
+#ifndef _RTMEM_H_
+#define _RTMEM_H_
+
+
+// Constants
+#define RTMEM_ALIGN				(64)				// Alignment of allocations (a cache line)
+#define RTMEM_HUGE_PAGE_SIZE	(2 * 1024 * 1024)	// Size of an explicit huge page
+
+
+// Globals
+extern int rtmem_lock;
+extern int rtmem_huge;
+
+
+// Prototypes
+void init_rtmem( size_t size );
+void finish_rtmem();
+void* rtmem_alloc( size_t size );
+int rtmem_owns( void* ptr );
+size_t rtmem_ringbuffer_bytes( size_t sz );
+jack_ringbuffer_t* rtmem_ringbuffer_create( size_t sz );
+void rtmem_ringbuffer_free( jack_ringbuffer_t* rb );
+void* rtmem_malloc( size_t size, int *locked );
+void rtmem_free( void* ptr, size_t size, int locked );
+
+#endif
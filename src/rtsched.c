@@ -0,0 +1,314 @@
+/*
+
+	rtsched.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "madjack.h"
+#include "rtsched.h"
+#include "config.h"
+
+
+/*
+ * The decoder thread can be given a real-time priority (below JACK's
+ * own), and it and the OSC server thread can be kept to a set of CPUs.
+ *
+ * If a danger level is set with -D, the decoder thread is raised to
+ * just below JACK's priority while the ringbuffer holds less than that
+ * many seconds of audio, and dropped back once it has twice as much.
+ */
+
+
+// ------- Globals -------
+int decoder_priority = 0;				// Real-time priority of decoder (0 for normal)
+float danger_duration = 0.0f;			// Boost decoder below this fill (in seconds)
+
+static int decoder_policy = SCHED_FIFO;	// Scheduling policy when real-time
+static int boost_priority = 0;			// Priority when boosted
+static int boosted = 0;					// Set while the decoder is boosted
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+static cpu_set_t decoder_cpus;			// CPUs the decoder may run on
+static cpu_set_t osc_cpus;				// CPUs the OSC server may run on
+static cpu_set_t saved_cpus;			// CPUs of main thread, while starting OSC
+static int have_decoder_cpus = 0;
+static int have_osc_cpus = 0;
+#endif
+
+
+
+// Parse a priority, optionally starting with "fifo:" or "rr:"
+// Returns 0 on success
+int parse_decoder_priority( const char* arg )
+{
+	if (strncmp( arg, "rr:", 3 ) == 0) {
+		decoder_policy = SCHED_RR;
+		arg += 3;
+	} else if (strncmp( arg, "fifo:", 5 ) == 0) {
+		decoder_policy = SCHED_FIFO;
+		arg += 5;
+	}
+	
+	decoder_priority = atoi( arg );
+	if (decoder_priority < sched_get_priority_min( decoder_policy ) ||
+	    decoder_priority > sched_get_priority_max( decoder_policy )) return -1;
+	
+	return 0;
+}
+
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+
+// Parse a list of CPUs, such as "0,2-3"
+// Returns 0 on success
+static
+int parse_cpuset( const char* arg, cpu_set_t *set )
+{
+	CPU_ZERO( set );
+	
+	while (*arg) {
+		char *end = NULL;
+		long first = strtol( arg, &end, 10 );
+		long last = first;
+		
+		if (end == arg || first < 0) return -1;
+		if (*end == '-') {
+			arg = end + 1;
+			last = strtol( arg, &end, 10 );
+			if (end == arg || last < first) return -1;
+		}
+		if (last >= CPU_SETSIZE) return -1;
+		
+		for (; first <= last; first++) CPU_SET( first, set );
+		
+		if (*end == ',') end++;
+		else if (*end) return -1;
+		arg = end;
+	}
+	
+	return CPU_COUNT( set ) ? 0 : -1;
+}
+
+
+// Describe a set of CPUs, for reporting
+static
+void describe_cpuset( cpu_set_t *set, char *str, size_t len )
+{
+	size_t used = 0;
+	int i;
+	
+	str[0] = '\0';
+	for (i=0; i<CPU_SETSIZE && used+8 < len; i++) {
+		if (CPU_ISSET( i, set ))
+			used += snprintf( str+used, len-used, used ? ",%d" : "%d", i );
+	}
+}
+
+#endif
+
+
+int parse_decoder_cpus( const char* arg )
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	if (parse_cpuset( arg, &decoder_cpus )) return -1;
+	have_decoder_cpus = 1;
+	return 0;
+#else
+	fprintf(stderr, "Warning: setting CPU affinity isn't supported on this system.\n");
+	return 0;
+#endif
+}
+
+
+int parse_osc_cpus( const char* arg )
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	if (parse_cpuset( arg, &osc_cpus )) return -1;
+	have_osc_cpus = 1;
+	return 0;
+#else
+	fprintf(stderr, "Warning: setting CPU affinity isn't supported on this system.\n");
+	return 0;
+#endif
+}
+
+
+// Set the scheduling of the calling thread
+// Returns 0 on success, or an errno value
+static
+int set_thread_priority( int policy, int priority )
+{
+	struct sched_param param;
+	
+	bzero( &param, sizeof(param) );
+	param.sched_priority = priority;
+	
+	return pthread_setschedparam( pthread_self(), priority ? policy : SCHED_OTHER, &param );
+}
+
+
+// Work out priorities, and check that they can actually be applied
+void init_rtsched()
+{
+	int jack_priority = -1;
+	int err;
+	
+	if (jack_is_realtime( client ))
+		jack_priority = jack_client_real_time_priority( client );
+	
+	// Keep the decoder below JACK's own threads
+	if (jack_priority > 0 && decoder_priority >= jack_priority) {
+		fprintf(stderr, "Warning: decoder priority lowered to %d, below JACK's priority of %d.\n",
+		        jack_priority - 1, jack_priority);
+		decoder_priority = jack_priority - 1;
+	}
+	
+	if (danger_duration > 0.0f) {
+		if (jack_priority > 1) boost_priority = jack_priority - 1;
+		else boost_priority = decoder_priority + RTSCHED_BOOST;
+		if (boost_priority > sched_get_priority_max( decoder_policy ))
+			boost_priority = sched_get_priority_max( decoder_policy );
+		if (boost_priority < decoder_priority) boost_priority = decoder_priority;
+	}
+	
+	// Try them out on this thread, then put it back
+	if (decoder_priority || boost_priority) {
+		err = set_thread_priority( decoder_policy, boost_priority ? boost_priority : decoder_priority );
+		if (err) {
+			fprintf(stderr, "Warning: can't use real-time scheduling for decoder: %s\n", strerror( err ));
+			decoder_priority = 0;
+			boost_priority = 0;
+		}
+		set_thread_priority( SCHED_OTHER, 0 );
+	}
+	
+	if (!quiet) {
+		if (decoder_priority) {
+			printf("Decoder thread scheduling: %s, priority %d.\n",
+			       decoder_policy == SCHED_RR ? "SCHED_RR" : "SCHED_FIFO", decoder_priority);
+		} else if (verbose) {
+			printf("Decoder thread scheduling: normal.\n");
+		}
+		if (boost_priority) {
+			printf("Decoder thread is raised to priority %d below %2.2f seconds of audio.\n",
+			       boost_priority, danger_duration);
+		}
+	}
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	if (have_decoder_cpus) {
+		cpu_set_t current;
+		char str[256];
+		
+		pthread_getaffinity_np( pthread_self(), sizeof(current), &current );
+		err = pthread_setaffinity_np( pthread_self(), sizeof(decoder_cpus), &decoder_cpus );
+		pthread_setaffinity_np( pthread_self(), sizeof(current), &current );
+		if (err) {
+			fprintf(stderr, "Warning: can't set CPUs for decoder: %s\n", strerror( err ));
+			have_decoder_cpus = 0;
+		} else if (!quiet) {
+			describe_cpuset( &decoder_cpus, str, sizeof(str) );
+			printf("Decoder thread CPUs: %s.\n", str);
+		}
+	}
+#endif
+}
+
+
+// Called at the start of each decoder thread
+void rtsched_decoder_thread()
+{
+	boosted = 0;
+	
+	if (decoder_priority) {
+		int err = set_thread_priority( decoder_policy, decoder_priority );
+		if (err) fprintf(stderr, "Warning: failed to set decoder priority: %s\n", strerror( err ));
+	}
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	if (have_decoder_cpus) {
+		pthread_setaffinity_np( pthread_self(), sizeof(decoder_cpus), &decoder_cpus );
+	}
+#endif
+}
+
+
+// Called by the decoder thread with the number of bytes in the ringbuffer
+void rtsched_watch_fill( size_t fill )
+{
+	float seconds;
+	
+	if (!boost_priority) return;
+	seconds = (float)fill / (jack_get_sample_rate( client ) * sizeof(float));
+	
+	if (!boosted && seconds < danger_duration &&
+	    get_state() == MADJACK_STATE_PLAYING)
+	{
+		if (verbose) printf("Ringbuffer low (%2.2f seconds), raising decoder priority.\n", seconds);
+		set_thread_priority( decoder_policy, boost_priority );
+		boosted = 1;
+	}
+	else if (boosted && seconds > danger_duration * 2)
+	{
+		if (verbose) printf("Ringbuffer recovered, dropping decoder priority.\n");
+		set_thread_priority( decoder_policy, decoder_priority );
+		boosted = 0;
+	}
+}
+
+
+// The OSC server thread takes on the CPUs of the thread that starts it
+void rtsched_before_osc_thread()
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	if (have_osc_cpus) {
+		char str[256];
+		int err;
+	
+		pthread_getaffinity_np( pthread_self(), sizeof(saved_cpus), &saved_cpus );
+		err = pthread_setaffinity_np( pthread_self(), sizeof(osc_cpus), &osc_cpus );
+		if (err) {
+			fprintf(stderr, "Warning: can't set CPUs for OSC server: %s\n", strerror( err ));
+			have_osc_cpus = 0;
+		} else if (!quiet) {
+			describe_cpuset( &osc_cpus, str, sizeof(str) );
+			printf("OSC server thread CPUs: %s.\n", str);
+		}
+	}
+#endif
+}
+
+
+void rtsched_after_osc_thread()
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	if (have_osc_cpus) {
+		pthread_setaffinity_np( pthread_self(), sizeof(saved_cpus), &saved_cpus );
+	}
+#endif
+}
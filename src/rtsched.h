@@ -0,0 +1,49 @@
+/*
+
+	rtsched.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include <stddef.h>
+
+#ifndef _RTSCHED_H_
+#define _RTSCHED_H_
+
+
+// Constants
+#define RTSCHED_BOOST			(10)		// Priority to boost a normal decoder thread to
+
+
+// Globals
+extern int decoder_priority;
+extern float danger_duration;
+
+
+// Prototypes
+int parse_decoder_priority( const char* arg );
+int parse_decoder_cpus( const char* arg );
+int parse_osc_cpus( const char* arg );
+void init_rtsched();
+void rtsched_decoder_thread();
+void rtsched_watch_fill( size_t fill );
+void rtsched_before_osc_thread();
+void rtsched_after_osc_thread();
+
+#endif
@@ -0,0 +1,294 @@
+/*
+
+	schedule.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "madjack.h"
+#include "control.h"
+#include "command.h"
+#include "schedule.h"
+#include "config.h"
+
+
+/*
+ * /deck/play and /deck/stop can be sent in an OSC bundle with a
+ * timetag in the future. The timetag is turned into a JACK frame time
+ * when it arrives, and the JACK callback starts (or stops) the audio
+ * at that frame, part way through the period if need be.
+ *
+ * A scheduled stop pauses the output at the exact frame; the rest of
+ * stopping the deck is done afterwards by the scheduler thread.
+ *
+ * To measure the error, the time of the first audible sample after each
+ * timetagged start is taken from JACK's clock (via jack_frames_to_time),
+ * and compared with the time the timetag asked for.
+ */
+
+
+// ------- Globals -------
+static pthread_t scheduler_thread;				// Thread that finishes scheduled stops
+static int scheduler_running = 0;				// Cleared to stop the thread
+
+static volatile int play_pending = 0;			// Set when a start has been scheduled
+static volatile jack_nframes_t play_frame = 0;	// JACK frame time to start at
+static volatile jack_time_t play_time = 0;		// JACK time the timetag asked for (0 if none)
+static volatile int stop_pending = 0;			// Set when a stop has been scheduled
+static volatile jack_nframes_t stop_frame = 0;	// JACK frame time to stop at
+static volatile int stop_reached = 0;			// Set by the callback once output has stopped
+
+static int errors[SCHEDULE_HISTORY];			// Frames late (or early, if negative) for each start
+static unsigned long starts = 0;				// Number of scheduled starts
+static unsigned long late_starts = 0;			// Number that started late
+static unsigned long measured = 0;				// Number of timetagged starts measured
+static jack_time_t onset_time = 0;				// JACK time the start being measured was due
+static jack_nframes_t onset_waited = 0;			// Frames played waiting for it to be audible
+static jack_nframes_t last_start = 0;			// JACK frame time of the last scheduled start
+static float min_margin = 0.0f;					// Least time in hand on arrival (in seconds)
+
+
+
+// Start playing at a JACK frame time, measuring against 'time' if it isn't 0
+static
+void start_at_frame( jack_nframes_t frame, jack_time_t time )
+{
+	play_frame = frame;
+	play_time = time;
+	__sync_synchronize();
+	play_pending = 1;
+}
+
+
+// Called from the OSC thread when a /deck/play has a timetag
+void schedule_play( jack_nframes_t frame, jack_time_t time, float margin )
+{
+	if (verbose) printf("-> schedule_play(%u) with %2.1f ms in hand\n", frame, margin * 1000.0f);
+	
+	if (starts == 0 || margin < min_margin) min_margin = margin;
+	
+	start_at_frame( frame, time );
+}
+
+
+// Start playing at a JACK frame time (safe to call from the JACK callback)
+void schedule_start( jack_nframes_t frame )
+{
+	start_at_frame( frame, 0 );
+}
+
+
+// Called from the OSC thread when a /deck/stop has a timetag
+void schedule_stop( jack_nframes_t frame )
+{
+	if (verbose) printf("-> schedule_stop(%u)\n", frame);
+
+	stop_frame = frame;
+	__sync_synchronize();
+	stop_pending = 1;
+}
+
+
+// Is a start waiting for its frame ?
+int schedule_start_pending()
+{
+	return play_pending;
+}
+
+
+static
+int can_start()
+{
+	return (get_state() == MADJACK_STATE_READY ||
+	        get_state() == MADJACK_STATE_PAUSED ||
+	        (get_state() == MADJACK_STATE_STOPPED && warm_stopped));
+}
+
+
+// Called at the start of each period by the JACK callback,
+// to find the part of the period that should be played
+void schedule_process( jack_nframes_t nframes, jack_nframes_t *start_at, jack_nframes_t *stop_at )
+{
+	jack_nframes_t now = jack_last_frame_time( client );
+	
+	if (play_pending) {
+		int offset = (int)(play_frame - now);
+		
+		if (offset < (int)nframes) {
+			if (can_start()) {
+				play_pending = 0;
+				*start_at = offset > 0 ? offset : 0;
+				if (offset < 0) late_starts++;
+				last_start = now + *start_at;
+				starts++;
+				
+				// Measure it once the audio comes out
+				onset_time = play_time;
+				onset_waited = 0;
+				set_state( MADJACK_STATE_PLAYING );
+			} else if (get_state() != MADJACK_STATE_LOADING) {
+				// Nothing to play
+				play_pending = 0;
+			}
+		}
+	}
+	
+	if (stop_pending) {
+		int offset = (int)(stop_frame - now);
+		
+		if (offset < (int)nframes) {
+			stop_pending = 0;
+			if (get_state() == MADJACK_STATE_PLAYING && offset >= (int)*start_at) {
+				*stop_at = offset;
+				stop_reached = 1;
+			}
+		}
+	}
+}
+
+
+// Called by the JACK callback once the output has been written, to find
+// the first audible sample after a timetagged start
+void schedule_measure( float *out[2], jack_nframes_t start_at, jack_nframes_t nframes )
+{
+	jack_nframes_t rate = jack_get_sample_rate( client );
+	jack_nframes_t i;
+	
+	if (onset_time == 0) return;
+	
+	for (i=start_at; i<nframes; i++) {
+		if (fabsf( out[0][i] ) > SCHEDULE_ONSET_LEVEL ||
+		    fabsf( out[1][i] ) > SCHEDULE_ONSET_LEVEL)
+		{
+			jack_time_t time = jack_frames_to_time( client, jack_last_frame_time( client ) + i );
+			double error = ((double)time - (double)onset_time) * rate / 1000000.0;
+			
+			errors[measured % SCHEDULE_HISTORY] = (int)floor( error + 0.5 );
+			measured++;
+			onset_time = 0;
+			return;
+		}
+	}
+	
+	// Give up on a track that starts with silence
+	onset_waited += nframes - start_at;
+	if (onset_waited > SCHEDULE_ONSET_LIMIT * rate) onset_time = 0;
+}
+
+
+// Number of scheduled starts so far, and the frame the last one began at
+unsigned long schedule_get_last_start( jack_nframes_t *frame )
+{
+	*frame = last_start;
+	return starts;
+}
+
+
+static
+int compare_frames( const void *a, const void *b )
+{
+	int fa = *(const int*)a;
+	int fb = *(const int*)b;
+	return (fa > fb) - (fa < fb);
+}
+
+
+// The median error is signed, the 99th percentile and worst are its size
+void schedule_get_stats( unsigned long *count, unsigned long *late,
+                         unsigned long *count_measured, long *median,
+                         unsigned long *p99, unsigned long *max, float *margin )
+{
+	int sorted[SCHEDULE_HISTORY];
+	unsigned long n = measured < SCHEDULE_HISTORY ? measured : SCHEDULE_HISTORY;
+	unsigned long i;
+	
+	*count = starts;
+	*late = late_starts;
+	*count_measured = measured;
+	*margin = min_margin;
+	*median = 0;
+	*p99 = *max = 0;
+	if (n == 0) return;
+	
+	memcpy( sorted, errors, n * sizeof(int) );
+	qsort( sorted, n, sizeof(int), compare_frames );
+	*median = sorted[n / 2];
+	
+	for (i=0; i<n; i++) sorted[i] = abs( sorted[i] );
+	qsort( sorted, n, sizeof(int), compare_frames );
+	*p99 = sorted[(n * 99) / 100];
+	*max = sorted[n - 1];
+}
+
+
+// Finish a scheduled stop (run by the control worker)
+void schedule_finish_stop()
+{
+	// (unless the deck has been started again since)
+	if (get_state() == MADJACK_STATE_PAUSED) do_stop();
+}
+
+
+static
+void* thread_scheduler( void* arg )
+{
+	while (scheduler_running) {
+		// Output has been paused at the right frame, finish stopping
+		if (stop_reached && get_state() == MADJACK_STATE_PAUSED) {
+			command_t cmd;
+			
+			stop_reached = 0;
+			command_init( &cmd, COMMAND_FINISH_STOP );
+			command_submit( &cmd );
+		}
+		
+		usleep( 1000 );
+	}
+	
+	return NULL;
+}
+
+
+void init_schedule()
+{
+	int result;
+
+	scheduler_running = 1;
+	result = pthread_create( &scheduler_thread, NULL, thread_scheduler, NULL );
+	if (result) {
+		fprintf(stderr, "Error: return code from pthread_create() is %d\n", result);
+		exit(-1);
+	}
+}
+
+
+void finish_schedule()
+{
+	if (!scheduler_running) return;
+	
+	scheduler_running = 0;
+	pthread_join( scheduler_thread, NULL );
+}
+
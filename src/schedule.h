@@ -0,0 +1,51 @@
+/*
+
+	schedule.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "madjack.h"
+
+#ifndef _SCHEDULE_H_
+#define _SCHEDULE_H_
+
+
+// Constants
+#define SCHEDULE_HISTORY		(256)		// Number of scheduled starts to keep statistics for
+#define SCHEDULE_ONSET_LEVEL	(0.0001f)	// Quietest sample that counts as the start (-80dB)
+#define SCHEDULE_ONSET_LIMIT	(1)			// Longest to wait for it (in seconds)
+
+
+// Prototypes
+void init_schedule();
+void finish_schedule();
+void schedule_play( jack_nframes_t frame, jack_time_t time, float margin );
+void schedule_stop( jack_nframes_t frame );
+void schedule_finish_stop();
+void schedule_start( jack_nframes_t frame );
+int schedule_start_pending();
+unsigned long schedule_get_last_start( jack_nframes_t *frame );
+void schedule_process( jack_nframes_t nframes, jack_nframes_t *start_at, jack_nframes_t *stop_at );
+void schedule_measure( float *out[2], jack_nframes_t start_at, jack_nframes_t nframes );
+void schedule_get_stats( unsigned long *starts, unsigned long *late,
+                         unsigned long *measured, long *median,
+                         unsigned long *p99, unsigned long *max, float *min_margin );
+
+#endif
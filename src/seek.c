@@ -0,0 +1,109 @@
+/*
+
+	seek.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "madjack.h"
+#include "maddecode.h"
+#include "pcmbuffer.h"
+#include "preload.h"
+#include "overlay.h"
+#include "seek.h"
+#include "config.h"
+
+
+// ------- Globals -------
+static pcm_buffer_t *seek_buffer[SEEK_BUFFERS];		// Audio decoded from seek points
+
+
+
+/*
+ * Decode the audio at a new position into memory, using a file
+ * handle of our own, so that the decoder thread keeps on filling
+ * the ringbuffer with the audio that is currently playing.
+ *
+ * Returns the buffer, or NULL on failure.
+ * 'frame' is set to the MPEG Audio frame that the buffer starts at.
+ */
+
+pcm_buffer_t* decode_seek_buffer( float cuepoint, unsigned long *frame )
+{
+	pcm_buffer_t *pcm = NULL;
+	FILE* file = NULL;
+	int at_eof = 0;
+	long samples;
+	int i;
+	
+	// Use a buffer that isn't being played
+	for (i=0; i<SEEK_BUFFERS; i++) {
+		if (seek_buffer[i] == NULL) {
+			seek_buffer[i] = init_pcm_buffer( SEEK_PREROLL_FRAMES * SAMPLES_PER_FRAME );
+		}
+		if (!overlay_is_using( seek_buffer[i] )) {
+			pcm = seek_buffer[i];
+			break;
+		}
+	}
+	if (pcm == NULL) return NULL;
+	
+	*frame = cuepoint_to_frame( input_file, cuepoint );
+	
+	file = reopen_input_file( input_file );
+	if (file == NULL) {
+		fprintf(stderr, "Warning: failed to open file to seek.\n");
+		return NULL;
+	}
+	
+	samples = decode_to_buffer( input_file, file, *frame, pcm, &at_eof );
+	fclose( file );
+	
+	if (samples <= 0) return NULL;
+	return pcm;
+}
+
+
+void finish_seek()
+{
+	int i;
+	
+	for (i=0; i<SEEK_BUFFERS; i++) {
+		finish_pcm_buffer( seek_buffer[i] );
+		seek_buffer[i] = NULL;
+	}
+}
+
+
+unsigned long seek_memory_usage()
+{
+	unsigned long total = 0;
+	int i;
+	
+	for (i=0; i<SEEK_BUFFERS; i++) {
+		total += pcm_buffer_bytes( seek_buffer[i] );
+	}
+	
+	return total;
+}
+
@@ -0,0 +1,40 @@
+/*
+
+	seek.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "madjack.h"
+
+#ifndef _SEEK_H_
+#define _SEEK_H_
+
+
+// Constants
+#define SEEK_PREROLL_FRAMES		(40)		// MPEG Audio frames (about a second)
+#define SEEK_BUFFERS			(2)
+
+
+// Prototypes
+pcm_buffer_t* decode_seek_buffer( float cuepoint, unsigned long *frame );
+void finish_seek();
+unsigned long seek_memory_usage();
+
+#endif
@@ -0,0 +1,172 @@
+/*
+
+	status.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+
+#include <jack/jack.h>
+#include <jack/ringbuffer.h>
+
+#include "madjack.h"
+#include "status.h"
+#include "config.h"
+
+
+/*
+ * A copy of the deck's status is kept behind a sequence lock, so that
+ * all of it can be read at once without the fields disagreeing, and
+ * without the reader ever blocking the JACK callback.
+ *
+ * The JACK callback updates the state, position, fill and output levels
+ * every period. Whenever the track or error changes, the control thread
+ * updates everything. Writers take turns using a spinlock; the JACK
+ * callback only tries it, and leaves the update to the next period if
+ * another thread is part way through writing.
+ *
+ * The status lives in a shared memory segment named after the JACK
+ * client, so that other programs on the host can read it too (see
+ * statusreader.h).
+ */
+
+
+// ------- Globals -------
+static status_page_t private_page;				// Used until the shared page exists
+static status_page_t *page = &private_page;		// Where the status is written
+static char page_name[STATUS_MAX_PATH] = "";	// Name of the shared memory segment
+static volatile int status_writing = 0;			// Spinlock for writers
+static float levels[2] = {0.0f, 0.0f};			// Peak levels of the last period
+
+
+
+// Called by the JACK callback with the peak level of each output
+void status_set_levels( float left, float right )
+{
+	levels[0] = left;
+	levels[1] = right;
+}
+
+
+// Update the status
+// If track is set, the track details and error are updated too
+// (the JACK callback must not set it)
+void status_update( int track )
+{
+	deck_status_t *status = &page->status;
+	unsigned int rate;
+
+	if (!input_file || !client) return;
+	
+	// Take turns with the other writers
+	while (__sync_lock_test_and_set( &status_writing, 1 )) {
+		if (!track) return;
+		sched_yield();
+	}
+	
+	page->seq++;
+	__sync_synchronize();
+	
+	rate = jack_get_sample_rate( client );
+	status->state = get_state();
+	strncpy( status->state_name, get_state_name( status->state ), STATUS_MAX_STATE - 1 );
+	status->position = input_file->position;
+	status->position_samples = (unsigned int)(input_file->position * rate + 0.5f);
+	status->buffered = (float)jack_ringbuffer_read_space( ringbuffer[0] ) / (rate * sizeof(float));
+	status->level[0] = levels[0];
+	status->level[1] = levels[1];
+	
+	if (track) {
+		const char *filepath = input_file->filepath;
+		status->duration = input_file->duration;
+		snprintf( status->filepath, STATUS_MAX_PATH, "%s", filepath ? filepath : "" );
+		snprintf( status->error, STATUS_MAX_ERROR, "%s", error_string );
+	}
+	
+	__sync_synchronize();
+	page->seq++;
+	__sync_lock_release( &status_writing );
+}
+
+
+// Take a copy of the status, all from the same moment
+void get_status( deck_status_t *snapshot )
+{
+	while (status_read( page, snapshot )) {
+		sched_yield();
+	}
+}
+
+
+// Create the shared memory segment for the status
+void init_status( const char* client_name )
+{
+	status_page_t *shared;
+	int fd;
+	
+	status_page_name( page_name, sizeof(page_name), client_name );
+	
+	// (left behind if a deck with the same name crashed)
+	shm_unlink( page_name );
+	
+	fd = shm_open( page_name, O_RDWR|O_CREAT|O_EXCL, 0644 );
+	if (fd < 0 || ftruncate( fd, sizeof(status_page_t) )) {
+		perror("failed to create status page");
+		if (fd >= 0) close( fd );
+		page_name[0] = '\0';
+		return;
+	}
+	
+	shared = mmap( NULL, sizeof(status_page_t), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	if (shared == MAP_FAILED) {
+		perror("failed to map status page");
+		shm_unlink( page_name );
+		page_name[0] = '\0';
+		return;
+	}
+	
+	// Carry over anything written so far
+	memcpy( &shared->status, &private_page.status, sizeof(deck_status_t) );
+	shared->size = sizeof(status_page_t);
+	shared->version = STATUS_VERSION;
+	__sync_synchronize();
+	shared->magic = STATUS_MAGIC;
+	page = shared;
+	
+	if (verbose) printf("Publishing status in shared memory as %s.\n", page_name);
+}
+
+
+void finish_status()
+{
+	if (page == &private_page) return;
+	
+	shm_unlink( page_name );
+	munmap( page, sizeof(status_page_t) );
+	page = &private_page;
+}
+
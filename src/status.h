@@ -0,0 +1,38 @@
+/*
+
+	status.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "madjack.h"
+#include "statusreader.h"
+
+#ifndef _STATUS_H_
+#define _STATUS_H_
+
+
+// Prototypes
+void init_status( const char* client_name );
+void finish_status();
+void status_update( int track );
+void status_set_levels( float left, float right );
+void get_status( deck_status_t *snapshot );
+
+#endif
@@ -0,0 +1,110 @@
+/*
+
+	statusreader.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+
+#include "statusreader.h"
+
+
+#define STATUS_SPINS		(1000)		// Tries before giving up the CPU to the writer
+#define STATUS_ATTEMPTS		(100000)	// Tries before giving up altogether
+
+
+
+// Name of the shared memory segment for a JACK client name
+// (a client name can contain '/', which a segment name can't after the first)
+void status_page_name( char *name, size_t size, const char* client_name )
+{
+	char *c;
+	
+	snprintf( name, size, STATUS_SHM_NAME, client_name );
+	for (c = name + 1; *c; c++) {
+		if (*c == '/') *c = '_';
+	}
+}
+
+
+// Map the status page of the deck with a JACK client name
+// Returns NULL if the deck isn't running
+status_page_t* status_reader_open( const char* client_name )
+{
+	char name[STATUS_MAX_PATH];
+	status_page_t *page;
+	int fd;
+	
+	status_page_name( name, sizeof(name), client_name );
+	fd = shm_open( name, O_RDONLY, 0 );
+	if (fd < 0) return NULL;
+	
+	page = mmap( NULL, sizeof(status_page_t), PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if (page == MAP_FAILED) return NULL;
+	
+	if (page->magic != STATUS_MAGIC || page->version != STATUS_VERSION ||
+	    page->size != sizeof(status_page_t))
+	{
+		fprintf(stderr, "Status page %s is not compatible.\n", name);
+		munmap( page, sizeof(status_page_t) );
+		return NULL;
+	}
+	
+	return page;
+}
+
+
+void status_reader_close( status_page_t* page )
+{
+	if (page) munmap( page, sizeof(status_page_t) );
+}
+
+
+// Take a copy of the status, all from the same moment
+// Returns 0 on success
+int status_read( const status_page_t* page, deck_status_t *snapshot )
+{
+	unsigned int seq, i;
+	
+	for (i=0; i<STATUS_ATTEMPTS; i++) {
+		seq = page->seq;
+		if (seq & 1) {
+			// Being written
+			if (i % STATUS_SPINS == STATUS_SPINS - 1) sched_yield();
+			continue;
+		}
+		
+		__sync_synchronize();
+		memcpy( snapshot, (const void*)&page->status, sizeof(deck_status_t) );
+		__sync_synchronize();
+		
+		if (seq == page->seq) return 0;
+	}
+	
+	return -1;
+}
+
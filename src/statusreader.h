@@ -0,0 +1,83 @@
+/*
+
+	statusreader.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include <stddef.h>
+
+#ifndef _STATUSREADER_H_
+#define _STATUSREADER_H_
+
+
+/*
+ * Each deck publishes its status in a POSIX shared memory segment,
+ * named after its JACK client. Local programs can read it without
+ * sending any packets or making any system calls:
+ *
+ *	status_page_t *page = status_reader_open( "madjack" );
+ *	deck_status_t status;
+ *	if (page && status_read( page, &status ) == 0) ...
+ *	status_reader_close( page );
+ *
+ * This header and statusreader.c are all that a reader needs.
+ */
+
+
+// Constants
+#define STATUS_SHM_NAME			"/madjack-status-%s"
+#define STATUS_MAGIC			(0x4d4a5354)		// 'MJST'
+#define STATUS_VERSION			(1)
+#define STATUS_MAX_PATH			(255)
+#define STATUS_MAX_ERROR		(255)
+#define STATUS_MAX_STATE		(16)
+
+
+// Everything about the deck, as it was at one moment
+typedef struct deck_status_struct {
+	int state;							// State of the deck (enum madjack_state)
+	char state_name[STATUS_MAX_STATE];	// Name of the state
+	float position;						// Position in the track (in seconds)
+	unsigned int position_samples;		// Position in the track (in samples)
+	float duration;						// Length of the track (in seconds)
+	float buffered;						// Decoded audio waiting to play (in seconds)
+	float level[2];						// Peak output level in the last period
+	char filepath[STATUS_MAX_PATH];		// Path of the track (as it was loaded)
+	char error[STATUS_MAX_ERROR];		// Last error that occurred
+} deck_status_t;
+
+
+// The shared memory segment
+typedef struct status_page_struct {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int size;					// Size of this structure
+	volatile unsigned int seq;			// Odd while the status is being written
+	deck_status_t status;
+} status_page_t;
+
+
+// Prototypes
+void status_page_name( char *name, size_t size, const char* client_name );
+status_page_t* status_reader_open( const char* client_name );
+void status_reader_close( status_page_t* page );
+int status_read( const status_page_t* page, deck_status_t *snapshot );
+
+#endif
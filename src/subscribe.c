@@ -0,0 +1,354 @@
+/*
+
+	subscribe.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <lo/lo.h>
+
+#include "madjack.h"
+#include "readahead.h"
+#include "subscribe.h"
+#include "status.h"
+#include "oscreply.h"
+#include "config.h"
+
+
+/*
+ * Instead of polling, clients can send /deck/subscribe and have the
+ * deck send them /deck/state (with /deck/duration and /deck/filepath)
+ * whenever the state changes, and /deck/position at the interval they
+ * asked for while it is changing.
+ *
+ * The publisher thread looks for changes every few milliseconds, so
+ * several changes in quick succession are sent as one message with
+ * the latest value. Subscriptions last for a lease period and must be
+ * renewed by subscribing again; clients that go away, or that can't be
+ * sent to, are dropped.
+ *
+ * The same updates can also be sent to a multicast group (-M), for any
+ * number of monitors to listen to without subscribing. The state is
+ * repeated every second, for monitors that start listening part way.
+ */
+
+
+typedef struct subscriber_struct {
+	lo_address addr;					// Where to send updates
+	lo_server serv;						// Server they subscribed through
+	unsigned long long interval;		// Time between position updates (0 for none)
+	unsigned long long expires;			// Time the lease runs out
+	unsigned long long next_position;	// Earliest time for the next position update
+	unsigned long long refresh;			// Time between repeats of the state (0 for none)
+	unsigned long long next_refresh;	// Time to next repeat the state
+	int state;							// Last state sent
+	float position;						// Last position sent
+	char filepath[STATUS_MAX_PATH];		// Last file path sent
+} subscriber_t;
+
+
+// ------- Globals -------
+static subscriber_t subscribers[SUBSCRIBE_MAX];
+static unsigned int subscriber_count = 0;
+static pthread_mutex_t subscribers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t publisher_thread;			// Thread that sends the updates
+static int publisher_running = 0;			// Cleared to stop the thread
+
+static osc_reply_t state_update;			// Updates, built once
+static osc_reply_t duration_update;
+static osc_reply_t filepath_update;
+static osc_reply_t position_update;
+
+static char *multicast_group = NULL;		// Multicast address to publish to
+static char *multicast_port = NULL;			// Port to publish to
+
+
+
+// Compare two strings, either of which may be NULL
+static
+int same_string( const char* a, const char* b )
+{
+	return strcmp( a ? a : "", b ? b : "" ) == 0;
+}
+
+
+// (Unix domain sockets have a port that is a path, and no hostname)
+static
+int same_address( lo_address a, lo_address b )
+{
+	return (lo_address_get_protocol(a) == lo_address_get_protocol(b) &&
+	        same_string( lo_address_get_hostname(a), lo_address_get_hostname(b) ) &&
+	        same_string( lo_address_get_port(a), lo_address_get_port(b) ));
+}
+
+
+// Find a subscriber (must hold lock)
+static
+subscriber_t* find_subscriber( lo_address addr )
+{
+	unsigned int i;
+	
+	for (i=0; i<subscriber_count; i++) {
+		if (same_address( subscribers[i].addr, addr )) return &subscribers[i];
+	}
+	
+	return NULL;
+}
+
+
+// Remove a subscriber (must hold lock)
+static
+void drop_subscriber( subscriber_t *sub )
+{
+	lo_address_free( sub->addr );
+	*sub = subscribers[--subscriber_count];
+}
+
+
+// Parse a multicast group and port, in the form <address>:<port>
+// Returns 0 on success
+int parse_multicast( const char* arg )
+{
+	const char *colon = strrchr( arg, ':' );
+	
+	if (!colon || colon == arg || colon[1] == '\0') {
+		fprintf(stderr, "Multicast group should be in the form <address>:<port>.\n");
+		return -1;
+	}
+	
+	multicast_group = strndup( arg, colon - arg );
+	multicast_port = strdup( colon + 1 );
+	
+	return 0;
+}
+
+
+// Subscribe (or renew the subscription of) the client at an address
+// Returns 0 on success
+int add_subscriber( lo_address addr, lo_server serv, int interval, int lease )
+{
+	unsigned long long now = get_usecs();
+	subscriber_t *sub;
+	int result = 0;
+	
+	if (interval > 0 && interval < SUBSCRIBE_MIN_INTERVAL) interval = SUBSCRIBE_MIN_INTERVAL;
+	if (lease <= 0) lease = SUBSCRIBE_LEASE;
+	
+	pthread_mutex_lock( &subscribers_lock );
+	
+	sub = find_subscriber( addr );
+	if (!sub && subscriber_count < SUBSCRIBE_MAX) {
+		// New subscriber - send everything on the next tick
+		sub = &subscribers[subscriber_count++];
+		sub->addr = lo_address_new_with_proto( lo_address_get_protocol( addr ),
+		                                       lo_address_get_hostname( addr ),
+		                                       lo_address_get_port( addr ) );
+		sub->serv = serv;
+		sub->state = MADJACK_STATE_STARTING - 1;
+		sub->position = -1.0f;
+		sub->next_position = now;
+		sub->refresh = 0;
+		
+		if (verbose) printf("New subscriber: %s:%s\n",
+		                    lo_address_get_hostname( addr ), lo_address_get_port( addr ));
+	}
+	
+	if (sub) {
+		sub->interval = interval * 1000ULL;
+		sub->expires = now + lease * 1000000ULL;
+	} else {
+		fprintf(stderr, "Warning: can't have more than %d subscribers.\n", SUBSCRIBE_MAX);
+		result = -1;
+	}
+	
+	pthread_mutex_unlock( &subscribers_lock );
+	
+	return result;
+}
+
+
+void remove_subscriber( lo_address addr )
+{
+	subscriber_t *sub;
+
+	pthread_mutex_lock( &subscribers_lock );
+	if ((sub = find_subscriber( addr ))) drop_subscriber( sub );
+	pthread_mutex_unlock( &subscribers_lock );
+}
+
+
+// Send a subscriber whatever has changed
+// Returns 0 on success
+static
+int publish( subscriber_t *sub, unsigned long long now )
+{
+	deck_status_t status;
+	osc_reply_t reply;
+	int result = 1;
+	
+	get_status( &status );
+	
+	// Time to repeat everything ?
+	if (sub->refresh && now >= sub->next_refresh) {
+		sub->state = MADJACK_STATE_STARTING - 1;
+		sub->position = -1.0f;
+		sub->next_refresh = now + sub->refresh;
+	}
+	
+	// (the playlist can move on to the next track without a change of state)
+	if (status.state != sub->state || strcmp( status.filepath, sub->filepath )) {
+		osc_reply_begin( &reply, &state_update );
+		osc_reply_add_string( &reply, status.state_name );
+		result = osc_reply_send( &reply, sub->addr, sub->serv );
+		
+		osc_reply_begin( &reply, &duration_update );
+		osc_reply_add_float( &reply, status.duration );
+		if (result > 0) result = osc_reply_send( &reply, sub->addr, sub->serv );
+		
+		osc_reply_begin( &reply, &filepath_update );
+		osc_reply_add_string( &reply, status.filepath );
+		if (result > 0) result = osc_reply_send( &reply, sub->addr, sub->serv );
+		
+		sub->state = status.state;
+		strcpy( sub->filepath, status.filepath );
+	}
+	
+	if (result > 0 && sub->interval && now >= sub->next_position &&
+	    status.position != sub->position)
+	{
+		osc_reply_begin( &reply, &position_update );
+		osc_reply_add_float( &reply, status.position );
+		result = osc_reply_send( &reply, sub->addr, sub->serv );
+		sub->position = status.position;
+		sub->next_position = now + sub->interval;
+	}
+	
+	return (result > 0) ? 0 : -1;
+}
+
+
+static
+void* thread_publisher( void* arg )
+{
+	while (publisher_running) {
+		unsigned long long now = get_usecs();
+		unsigned int i;
+		
+		pthread_mutex_lock( &subscribers_lock );
+		for (i=0; i<subscriber_count; ) {
+			subscriber_t *sub = &subscribers[i];
+			
+			if (now >= sub->expires) {
+				if (verbose) printf("Subscription expired: %s:%s\n",
+				                    lo_address_get_hostname( sub->addr ),
+				                    lo_address_get_port( sub->addr ));
+				drop_subscriber( sub );
+			} else if (publish( sub, now ) && !sub->refresh) {
+				fprintf(stderr, "Warning: dropping subscriber: %s\n", lo_address_errstr( sub->addr ));
+				drop_subscriber( sub );
+			} else {
+				i++;
+			}
+		}
+		pthread_mutex_unlock( &subscribers_lock );
+		
+		usleep( SUBSCRIBE_TICK * 1000 );
+	}
+	
+	return NULL;
+}
+
+
+// Limit how far multicast updates travel
+// (they are sent from the server's own socket, so liblo's TTL isn't used)
+static
+void set_multicast_ttl( lo_server serv )
+{
+	int fd = lo_server_get_socket_fd( serv );
+	unsigned char ttl = MULTICAST_TTL;
+	int hops = MULTICAST_TTL;
+	
+	if (setsockopt( fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl) ) &&
+	    setsockopt( fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &hops, sizeof(hops) ))
+	{
+		perror("failed to set multicast TTL");
+	}
+}
+
+
+void init_subscribe( lo_server serv )
+{
+	int result;
+	
+	osc_reply_template( &state_update, "/deck/state", "s" );
+	osc_reply_template( &duration_update, "/deck/duration", "f" );
+	osc_reply_template( &filepath_update, "/deck/filepath", "s" );
+	osc_reply_template( &position_update, "/deck/position", "f" );
+
+	// Publish to a multicast group, for as long as we are running
+	if (multicast_group) {
+		subscriber_t *sub = &subscribers[subscriber_count++];
+		
+		sub->addr = lo_address_new( multicast_group, multicast_port );
+		if (!sub->addr) {
+			fprintf(stderr, "Failed to create address for multicast group %s:%s.\n",
+			        multicast_group, multicast_port);
+			exit(1);
+		}
+		set_multicast_ttl( serv );
+		sub->serv = serv;
+		sub->interval = MULTICAST_INTERVAL * 1000ULL;
+		sub->refresh = MULTICAST_REFRESH * 1000000ULL;
+		sub->expires = ULLONG_MAX;
+		sub->state = MADJACK_STATE_STARTING - 1;
+		sub->position = -1.0f;
+		sub->next_position = sub->next_refresh = get_usecs();
+		
+		if (!quiet) printf("Publishing deck state to multicast group %s:%s.\n",
+		                   multicast_group, multicast_port);
+	}
+	
+	publisher_running = 1;
+	result = pthread_create( &publisher_thread, NULL, thread_publisher, NULL );
+	if (result) {
+		fprintf(stderr, "Error: return code from pthread_create() is %d\n", result);
+		exit(-1);
+	}
+}
+
+
+void finish_subscribe()
+{
+	if (!publisher_running) return;
+	
+	publisher_running = 0;
+	pthread_join( publisher_thread, NULL );
+	
+	while (subscriber_count) drop_subscriber( &subscribers[0] );
+}
+
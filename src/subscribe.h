@@ -0,0 +1,48 @@
+/*
+
+	subscribe.h
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "madjack.h"
+#include <lo/lo.h>
+
+#ifndef _SUBSCRIBE_H_
+#define _SUBSCRIBE_H_
+
+
+// Constants
+#define SUBSCRIBE_MAX			(64)		// Most clients that can subscribe at once
+#define SUBSCRIBE_TICK			(10)		// Milliseconds between checks for changes
+#define SUBSCRIBE_MIN_INTERVAL	(10)		// Shortest time between position updates (ms)
+#define SUBSCRIBE_LEASE			(30)		// Default seconds before a subscription expires
+#define MULTICAST_INTERVAL		(100)		// Milliseconds between multicast position updates
+#define MULTICAST_REFRESH		(1)			// Seconds between repeats of the multicast state
+#define MULTICAST_TTL			(1)			// Multicast hops (1 keeps it on the local network)
+
+
+// Prototypes
+int parse_multicast( const char* arg );
+void init_subscribe( lo_server serv );
+void finish_subscribe();
+int add_subscriber( lo_address addr, lo_server serv, int interval, int lease );
+void remove_subscriber( lo_address addr );
+
+#endif
@@ -0,0 +1,187 @@
+/*
+
+	transport.c
+	MPEG Audio Deck for the jack audio connection kit
+	Copyright (C) 2005  Nicholas J. Humfrey
+	
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <jack/transport.h>
+
+#include "madjack.h"
+#include "control.h"
+#include "command.h"
+#include "overlay.h"
+#include "loop.h"
+#include "cart.h"
+#include "readahead.h"
+#include "transport.h"
+#include "config.h"
+
+
+/*
+ * In follower mode, the JACK callback watches the transport each
+ * period. When it starts or stops rolling, or jumps somewhere other
+ * than where it would have been, the follower thread moves the deck
+ * to the same frame. Frame 0 of the transport is the start of the
+ * track.
+ *
+ * When the transport stops, the audio at the stopped position is
+ * decoded ready, so that starting again is quick. When the audio
+ * starts playing it is lined up with the transport frame of that
+ * period, so the deck stays sample locked however long it took.
+ */
+
+
+// ------- Globals -------
+int transport_follow = 0;						// Follow JACK transport
+
+static pthread_t follower_thread;				// Thread that moves the deck
+static int follower_running = 0;				// Cleared to stop the thread
+
+static volatile int locate_pending = 0;			// Set by callback when transport changes
+static volatile jack_nframes_t locate_frame = 0;	// Frame the transport moved to
+static volatile int locate_rolling = 0;			// Is the transport rolling ?
+static volatile int catch_up_queued = 0;		// Set while a catch up is waiting for the worker
+
+static jack_nframes_t expected_frame = 0;		// Where the transport should be next period
+static int was_rolling = 0;						// Was it rolling last period ?
+
+
+
+// Called at the start of each period by the JACK callback
+void transport_process( jack_nframes_t nframes )
+{
+	jack_position_t pos;
+	int rolling = (jack_transport_query( client, &pos ) == JackTransportRolling);
+
+	// Line up audio that has just been started with the transport
+	// (only in a period that the overlay is going to be played in)
+	if (get_state() == MADJACK_STATE_PLAYING && !loop_is_active() && !cart_is_loaded())
+		sync_overlay( pos.frame );
+	
+	// Has the transport started, stopped or moved ?
+	if (rolling != was_rolling || pos.frame != expected_frame) {
+		locate_frame = pos.frame;
+		locate_rolling = rolling;
+		__sync_synchronize();
+		locate_pending = 1;
+	}
+	
+	was_rolling = rolling;
+	expected_frame = rolling ? pos.frame + nframes : pos.frame;
+
+	// Position in the track is the transport position
+	if (rolling && get_state() == MADJACK_STATE_PLAYING) {
+		input_file->position = (float)pos.frame / jack_get_sample_rate( client );
+	}
+}
+
+
+// Move the deck to where the transport is (run by the control worker)
+void transport_locate( jack_nframes_t frame, int rolling, int catch_up )
+{
+	if (catch_up) {
+		catch_up_queued = 0;
+		frame = jack_get_current_transport_frame( client );
+	}
+	
+	do_locate( frame, rolling );
+}
+
+
+// Returns 0 on success
+static
+int submit_locate( jack_nframes_t frame, int rolling, int catch_up )
+{
+	command_t cmd;
+	
+	command_init( &cmd, COMMAND_LOCATE );
+	cmd.frame = frame;
+	cmd.value[0] = rolling;
+	cmd.index = catch_up;
+	return command_submit( &cmd );
+}
+
+
+static
+void* thread_follower( void* arg )
+{
+	while (follower_running) {
+		jack_nframes_t frame;
+		int rolling;
+	
+		if (locate_pending) {
+			unsigned long long start = get_usecs();
+			
+			locate_pending = 0;
+			__sync_synchronize();
+			frame = locate_frame;
+			rolling = locate_rolling;
+			
+			submit_locate( frame, rolling, 0 );
+			
+			if (verbose && rolling)
+				printf("Transport located to frame %u, queued after %2.2f ms.\n",
+				       frame, (get_usecs() - start) / 1000.0f);
+		}
+		else if (locate_rolling && !catch_up_queued &&
+		         (get_state() == MADJACK_STATE_READY ||
+		          get_state() == MADJACK_STATE_PAUSED))
+		{
+			// Track was loaded (or paused) while rolling - catch up
+			catch_up_queued = 1;
+			if (submit_locate( 0, 1, 1 )) catch_up_queued = 0;
+		}
+		
+		usleep( 1000 );
+	}
+	
+	return NULL;
+}
+
+
+void init_transport()
+{
+	int result;
+
+	// Follower mode disabled ?
+	if (!transport_follow) return;
+	
+	follower_running = 1;
+	result = pthread_create( &follower_thread, NULL, thread_follower, NULL );
+	if (result) {
+		fprintf(stderr, "Error: return code from pthread_create() is %d\n", result);
+		exit(-1);
+	}
+	
+	if (!quiet) printf("Following JACK transport.\n");
+}
+
+
+void finish_transport()
+{
+	if (!follower_running) return;
+	
+	follower_running = 0;
+	pthread_join( follower_thread, NULL );
+}